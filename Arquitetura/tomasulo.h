@@ -0,0 +1,5253 @@
+/* tomasulo.h
+   Núcleo do simulador do algoritmo de Tomasulo, como biblioteca só de
+   cabeçalho: máquina, programa, memória, SimuladorTomasulo e com_simulador().
+   Nada aqui imprime ou lê a entrada por conta própria; a saída de texto só
+   sai de executar() com verbosidade e das funções imprimir_*(). O programa de
+   linha de comando (trab2.cpp) é um cliente desta biblioteca.
+*/
+
+#ifndef TOMASULO_H
+#define TOMASULO_H
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <array>
+#include <cstring>
+#include <cctype>
+#include <algorithm>
+#include <cstdio>
+#include <cstdint>
+#include <type_traits>
+#include <memory>
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#else
+#include <direct.h>
+#endif
+#include <cerrno>
+#include <functional>
+#include <chrono>
+#include <atomic>
+#include <new>
+#include <cstdlib>
+#include <unordered_map>
+#include <cmath>
+
+// Tudo fica em 'tomasulo', com a biblioteca padrão sempre qualificada (std::),
+// para que 'using namespace tomasulo' não traga junto os nomes de std
+namespace tomasulo {
+
+/* Contador global de alocações no heap. Depois que o programa é carregado, o
+   laço de simulação não deve alocar nada; --verificar-alocacoes confere isso
+   comparando o contador antes e depois do laço. Quem conta é o operator new
+   do programa (trab2.cpp), e só com --verificar-alocacoes; sem ele, o
+   contador fica em zero. */
+inline std::atomic<size_t> alocacoes_heap{0};
+
+// Configuráveis: tamanhos das estruturas
+constexpr int REGISTRADORES = 32;
+// Memória de dados paginada: páginas de 2^BITS_PAGINA palavras, alocadas só
+// quando escritas, num espaço de endereçamento de 32 bits
+constexpr int BITS_PAGINA = 10;
+constexpr int PALAVRAS_PAGINA = 1 << BITS_PAGINA;
+// Endereços de dados usados pelos programas gerados e pelo benchmark
+constexpr int REGIAO_DADOS = 1024;
+
+// Multinúcleo: maior quantum de sincronização aceito (em ciclos)
+constexpr int QUANTUM_MAXIMO = 100000;
+// Extrapolação de laços: repetições do regime permanente exigidas por padrão
+constexpr int ITERACOES_EXTRAPOLACAO = 3;
+constexpr int RS_SOMA_COUNT = 6;
+constexpr int RS_MUL_COUNT = 3;
+constexpr int BUFFER_CARGA_COUNT = 4;
+constexpr int BUFFER_ARM_COUNT = 4;
+constexpr int TAM_ROB = 32;
+
+// Largura superescalar: instruções emitidas / consolidadas por ciclo
+constexpr int LARGURA_EMISSAO = 1;
+constexpr int LARGURA_COMMIT = 1;
+
+// Latências (em ciclos)
+constexpr int LAT_SOMA = 2;
+constexpr int LAT_MUL = 10;
+constexpr int LAT_DIV = 40;
+constexpr int LAT_CARGA = 2;
+constexpr int LAT_ARM = 2;
+
+// Preditor de desvios: 0 = estático (para trás tomado, para frente não
+// tomado), 1 = bimodal, 2 = gshare; tabelas com 2^BITS_PREDITOR contadores
+constexpr int PREDITOR = 1;
+constexpr int BITS_PREDITOR = 10;
+
+// Renomeação: 0 = valores especulativos no ROB (Tomasulo clássico); N > 0 =
+// banco de N registradores físicos com lista livre e tabela de mapeamento,
+// e o ROB só acompanha o término (precisa de mais de 32 por thread)
+constexpr int REGS_FISICOS = 0;
+
+// Unidades funcionais de soma (e desvios) e de mul/div, em pipeline: cada
+// uma inicia uma operação por ciclo (0 = uma unidade por estação). Com
+// DIV_ITERATIVO = 1 a DIV ocupa a sua unidade até terminar. BARRAMENTOS_CDB
+// limita os resultados transmitidos por ciclo (0 = sem limite).
+constexpr int UF_SOMA = 0;
+constexpr int UF_MUL = 0;
+constexpr int DIV_ITERATIVO = 0;
+constexpr int BARRAMENTOS_CDB = 0;
+
+// Hierarquia de caches de dados, com tamanhos em palavras de 32 bits. Com
+// L1_TAMANHO = 0 não há cache, e cargas e armazenamentos levam LAT_CARGA e
+// LAT_ARM ciclos. Com ela, a latência de cada acesso vem da consulta:
+// L1_LAT no acerto; na falta, mais L2_LAT (L2_TAMANHO = 0 = sem L2) e mais
+// LAT_MEMORIA se também faltar na L2. MSHRS limita as faltas da L1 em
+// andamento (0 = sem limite).
+constexpr int L1_TAMANHO = 0;
+constexpr int L1_ASSOC = 2;
+constexpr int L1_LAT = 2;
+constexpr int L2_TAMANHO = 0;
+constexpr int L2_ASSOC = 8;
+constexpr int L2_LAT = 10;
+constexpr int LINHA_CACHE = 8;
+constexpr int LAT_MEMORIA = 100;
+constexpr int MSHRS = 4;
+
+// SMT (várias threads de hardware num núcleo, com --smt): ROB_SMT 0 = ROB
+// dividido em partes iguais entre as threads, 1 = uma fila compartilhada;
+// POLITICA_SMT 0 = rodízio, 1 = ICOUNT
+constexpr int ROB_SMT_PARTICIONADO = 0, ROB_SMT_COMPARTILHADO = 1;
+constexpr int POLITICA_SMT_RODIZIO = 0, POLITICA_SMT_ICOUNT = 1;
+constexpr int ROB_SMT = ROB_SMT_PARTICIONADO;
+constexpr int POLITICA_SMT = POLITICA_SMT_ICOUNT;
+constexpr int MAX_THREADS_SMT = 8;
+const char* const NOMES_ROB_SMT[] = { "particionado", "compartilhado" };
+const char* const NOMES_POLITICA_SMT[] = { "rodizio", "icount" };
+
+// Instruções lidas antecipadamente ao abrir o programa (o restante é lido
+// sob demanda, conforme a emissão avança)
+constexpr int JANELA_ANTECIPACAO = 4096;
+
+// Configuração da máquina escolhida em tempo de execução. Os valores padrão
+// são as constantes acima; cada campo pode ser trocado por nome (ver
+// PARAMETROS_MAQUINA) sem recompilar.
+struct ConfigMaquina {
+    int rs_soma_count = RS_SOMA_COUNT;
+    int rs_mul_count = RS_MUL_COUNT;
+    int buffer_carga_count = BUFFER_CARGA_COUNT;
+    int buffer_arm_count = BUFFER_ARM_COUNT;
+    int tam_rob = TAM_ROB;
+    int largura_emissao = LARGURA_EMISSAO;
+    int largura_commit = LARGURA_COMMIT;
+    int lat_soma = LAT_SOMA;
+    int lat_mul = LAT_MUL;
+    int lat_div = LAT_DIV;
+    int lat_carga = LAT_CARGA;
+    int lat_arm = LAT_ARM;
+    int preditor = PREDITOR;
+    int bits_preditor = BITS_PREDITOR;
+    int regs_fisicos = REGS_FISICOS;
+    int uf_soma = UF_SOMA;
+    int uf_mul = UF_MUL;
+    int div_iterativo = DIV_ITERATIVO;
+    int barramentos_cdb = BARRAMENTOS_CDB;
+    int l1_tamanho = L1_TAMANHO;
+    int l1_assoc = L1_ASSOC;
+    int l1_lat = L1_LAT;
+    int l2_tamanho = L2_TAMANHO;
+    int l2_assoc = L2_ASSOC;
+    int l2_lat = L2_LAT;
+    int linha_cache = LINHA_CACHE;
+    int lat_memoria = LAT_MEMORIA;
+    int mshrs = MSHRS;
+    // SMT: fora de PARAMETROS_MAQUINA, porque checkpoints e varreduras são
+    // sempre de uma thread
+    int rob_smt = ROB_SMT;
+    int politica_smt = POLITICA_SMT;
+};
+
+struct ParametroMaquina {
+    const char* nome;
+    int ConfigMaquina::* campo;
+    int minimo;
+    int maximo;
+};
+
+// Parâmetros configuráveis, com o mesmo nome das constantes correspondentes
+const ParametroMaquina PARAMETROS_MAQUINA[] = {
+    { "RS_SOMA_COUNT",      &ConfigMaquina::rs_soma_count,      1, INT32_MAX },
+    { "RS_MUL_COUNT",       &ConfigMaquina::rs_mul_count,       1, INT32_MAX },
+    { "BUFFER_CARGA_COUNT", &ConfigMaquina::buffer_carga_count, 1, INT32_MAX },
+    { "BUFFER_ARM_COUNT",   &ConfigMaquina::buffer_arm_count,   1, INT32_MAX },
+    { "TAM_ROB",            &ConfigMaquina::tam_rob,            2, INT32_MAX },
+    { "LARGURA_EMISSAO",    &ConfigMaquina::largura_emissao,    1, INT32_MAX },
+    { "LARGURA_COMMIT",     &ConfigMaquina::largura_commit,     1, INT32_MAX },
+    { "LAT_SOMA",           &ConfigMaquina::lat_soma,           1, INT32_MAX },
+    { "LAT_MUL",            &ConfigMaquina::lat_mul,            1, INT32_MAX },
+    { "LAT_DIV",            &ConfigMaquina::lat_div,            1, INT32_MAX },
+    { "LAT_CARGA",          &ConfigMaquina::lat_carga,          1, INT32_MAX },
+    { "LAT_ARM",            &ConfigMaquina::lat_arm,            1, INT32_MAX },
+    { "PREDITOR",           &ConfigMaquina::preditor,           0, 2 },
+    { "BITS_PREDITOR",      &ConfigMaquina::bits_preditor,      1, 24 },
+    { "REGS_FISICOS",       &ConfigMaquina::regs_fisicos,       0, INT32_MAX },
+    { "UF_SOMA",            &ConfigMaquina::uf_soma,            0, INT32_MAX },
+    { "UF_MUL",             &ConfigMaquina::uf_mul,             0, INT32_MAX },
+    { "DIV_ITERATIVO",      &ConfigMaquina::div_iterativo,      0, 1 },
+    { "BARRAMENTOS_CDB",    &ConfigMaquina::barramentos_cdb,    0, INT32_MAX },
+    { "L1_TAMANHO",         &ConfigMaquina::l1_tamanho,         0, INT32_MAX },
+    { "L1_ASSOC",           &ConfigMaquina::l1_assoc,           1, INT32_MAX },
+    { "L1_LAT",             &ConfigMaquina::l1_lat,             1, INT32_MAX },
+    { "L2_TAMANHO",         &ConfigMaquina::l2_tamanho,         0, INT32_MAX },
+    { "L2_ASSOC",           &ConfigMaquina::l2_assoc,           1, INT32_MAX },
+    { "L2_LAT",             &ConfigMaquina::l2_lat,             1, INT32_MAX },
+    { "LINHA_CACHE",        &ConfigMaquina::linha_cache,        1, 1 << 20 },
+    { "LAT_MEMORIA",        &ConfigMaquina::lat_memoria,        1, INT32_MAX },
+    { "MSHRS",              &ConfigMaquina::mshrs,              0, INT32_MAX },
+};
+
+// Com o banco de registradores físicos, cada thread mantém 32 mapeados para
+// os registradores arquiteturais e precisa de pelo menos um livre para emitir
+inline bool regs_fisicos_suficientes(const ConfigMaquina& cfg, int threads) {
+    return cfg.regs_fisicos == 0 || cfg.regs_fisicos > REGISTRADORES * threads;
+}
+
+// Geometria das caches: linha em potência de 2 e cada tamanho múltiplo de
+// linha * associatividade. Devolve a mensagem de erro, ou "" se está certa.
+inline std::string erro_cache(const ConfigMaquina& cfg) {
+    if(cfg.l1_tamanho == 0) {
+        return cfg.l2_tamanho > 0 ? "L2_TAMANHO > 0 precisa de L1_TAMANHO > 0" : "";
+    }
+    if(cfg.linha_cache & (cfg.linha_cache - 1)) return "LINHA_CACHE precisa ser potencia de 2";
+    if(cfg.l1_tamanho % ((long long)cfg.linha_cache * cfg.l1_assoc) != 0) {
+        return "L1_TAMANHO precisa ser multiplo de LINHA_CACHE * L1_ASSOC";
+    }
+    if(cfg.l2_tamanho % ((long long)cfg.linha_cache * cfg.l2_assoc) != 0) {
+        return "L2_TAMANHO precisa ser multiplo de LINHA_CACHE * L2_ASSOC";
+    }
+    return "";
+}
+
+inline const ParametroMaquina* buscar_parametro(const std::string& nome) {
+    for(const auto& p : PARAMETROS_MAQUINA) {
+        if(nome == p.nome) return &p;
+    }
+    return nullptr;
+}
+
+/* Forma da máquina: tamanhos fixados na compilação. O simulador é
+   instanciado para cada forma predefinida, com arranjos de tamanho fixo e
+   laços de limite constante; uma configuração cujos tamanhos não casam com
+   nenhuma usa a FormaDinamica (tudo zero = dimensionado em tempo de
+   execução). Latências e preditor são sempre lidos da ConfigMaquina. */
+template<int SOMA, int MUL, int CARGA, int ARM, int ROB, int EMISSAO, int COMMIT>
+struct FormaMaquina {
+    static constexpr int rs_soma_count = SOMA;
+    static constexpr int rs_mul_count = MUL;
+    static constexpr int buffer_carga_count = CARGA;
+    static constexpr int buffer_arm_count = ARM;
+    static constexpr int tam_rob = ROB;
+    static constexpr int largura_emissao = EMISSAO;
+    static constexpr int largura_commit = COMMIT;
+    static constexpr bool dinamica = ROB == 0;
+
+    static bool aceita(const ConfigMaquina& c) {
+        return dinamica ||
+               (c.rs_soma_count == SOMA && c.rs_mul_count == MUL && c.buffer_carga_count == CARGA &&
+                c.buffer_arm_count == ARM && c.tam_rob == ROB &&
+                c.largura_emissao == EMISSAO && c.largura_commit == COMMIT);
+    }
+
+    // Ajusta os tamanhos de 'c' para os desta forma
+    static void aplicar(ConfigMaquina& c) {
+        c.rs_soma_count = SOMA; c.rs_mul_count = MUL;
+        c.buffer_carga_count = CARGA; c.buffer_arm_count = ARM;
+        c.tam_rob = ROB;
+        c.largura_emissao = EMISSAO; c.largura_commit = COMMIT;
+    }
+};
+
+// Máquinas predefinidas, escolhidas por nome com --maquina=
+struct FormaPequena : FormaMaquina<2, 1, 2, 2, 8, 1, 1> {
+    static const char* nome() { return "pequena"; }
+};
+struct FormaBase : FormaMaquina<RS_SOMA_COUNT, RS_MUL_COUNT, BUFFER_CARGA_COUNT, BUFFER_ARM_COUNT,
+                                TAM_ROB, LARGURA_EMISSAO, LARGURA_COMMIT> {
+    static const char* nome() { return "base"; }
+};
+struct FormaLarga : FormaMaquina<8, 4, 8, 8, 64, 4, 4> {
+    static const char* nome() { return "larga"; }
+};
+struct FormaEnorme : FormaMaquina<32, 16, 32, 32, 256, 8, 8> {
+    static const char* nome() { return "enorme"; }
+};
+struct FormaDinamica : FormaMaquina<0, 0, 0, 0, 0, 0, 0> {
+    static const char* nome() { return "dinamica"; }
+};
+
+template<class... Formas> struct ListaFormas {};
+using FormasPredefinidas = ListaFormas<FormaPequena, FormaBase, FormaLarga, FormaEnorme>;
+
+// Aplica os tamanhos da máquina predefinida 'nome'; false se não existe
+template<class... Formas>
+bool aplicar_predefinida(const std::string& nome, ConfigMaquina& cfg, ListaFormas<Formas...>) {
+    return ((nome == Formas::nome() ? (Formas::aplicar(cfg), true) : false) || ...);
+}
+
+template<class... Formas>
+std::string nomes_predefinidas(ListaFormas<Formas...>) {
+    std::string nomes;
+    ((nomes += (nomes.empty() ? "" : ", ") + std::string(Formas::nome())), ...);
+    return nomes;
+}
+
+/* Descrição de máquina em arquivo: uma atribuição NOME = VALOR por linha, com
+   os nomes de PARAMETROS_MAQUINA, e opcionalmente MAQUINA = nome para partir
+   de uma máquina predefinida; '#' inicia comentário. */
+inline bool ler_descricao_maquina(const std::string& arquivo, ConfigMaquina& cfg, std::string& erro) {
+    std::ifstream in(arquivo);
+    if(!in) {
+        erro = "Maquina desconhecida ou arquivo ilegivel: " + arquivo +
+               " (predefinidas: " + nomes_predefinidas(FormasPredefinidas()) + ")";
+        return false;
+    }
+    std::string linha;
+    for(int num = 1; std::getline(in, linha); num++) {
+        linha = linha.substr(0, linha.find('#'));
+        linha.erase(std::remove_if(linha.begin(), linha.end(), [](unsigned char c) { return isspace(c); }),
+                    linha.end());
+        if(linha.empty()) continue;
+        size_t igual = linha.find('=');
+        std::string nome = linha.substr(0, std::min(igual, linha.size()));
+        std::string valor = igual == std::string::npos ? "" : linha.substr(igual + 1);
+        const ParametroMaquina* p = buscar_parametro(nome);
+        char* fim = nullptr;
+        long v = strtol(valor.c_str(), &fim, 10);
+        bool ok = nome == "MAQUINA" ? aplicar_predefinida(valor, cfg, FormasPredefinidas())
+                                    : p && !valor.empty() && *fim == '\0' && v >= p->minimo && v <= p->maximo;
+        if(!ok) {
+            erro = arquivo + ":" + std::to_string(num) + ": atribuicao invalida: " + linha;
+            return false;
+        }
+        if(p) cfg.*(p->campo) = (int)v;
+    }
+    return true;
+}
+
+enum class TipoOp : uint8_t { ADD, SUB, MUL, DIV, LD, ST, BEQ, BNE, J, NOP };
+
+const char* const NOMES_OP[] = { "ADD", "SUB", "MUL", "DIV", "LD", "ST", "BEQ", "BNE", "J", "NOP" };
+
+// Desvios: o alvo é o índice da instrução de destino, guardado em imm
+inline bool eh_desvio(TipoOp t) {
+    return t == TipoOp::BEQ || t == TipoOp::BNE || t == TipoOp::J;
+}
+
+// Instruções que escrevem num registrador de destino
+inline bool escreve_registrador(TipoOp t) {
+    return t <= TipoOp::LD;
+}
+
+// Em LD e ST, src2 é o registrador base do endereço (desl(Rb)); sem base,
+// LD é carga imediata e ST grava no endereço absoluto imm
+constexpr int8_t SEM_BASE = -1;
+
+// Representação de uma instrução, já decodificada. São 12 bytes sem ponteiros:
+// o mesmo registro é gravado na imagem binária do programa (ImagemPrograma) e
+// o texto fica numa tabela à parte.
+struct Instr {
+    TipoOp tipo = TipoOp::NOP;
+    int8_t dest = 0;
+    int8_t src1 = 0;
+    int8_t src2 = SEM_BASE;
+    int32_t imm = 0;
+    uint32_t texto = 0;     // deslocamento na tabela de textos da imagem
+};
+static_assert(sizeof(Instr) == 12, "Instr e o registro da imagem binaria");
+
+// Arquivo inteiro mapeado em memória, somente leitura
+class ArquivoMapeado {
+private:
+    const char* p = nullptr;
+    size_t n = 0;
+
+public:
+    ArquivoMapeado() = default;
+    ArquivoMapeado(const ArquivoMapeado&) = delete;
+    ArquivoMapeado& operator=(const ArquivoMapeado&) = delete;
+    ~ArquivoMapeado() { fechar(); }
+
+    // false se o arquivo não existe, está vazio ou não pode ser mapeado
+    // (sem mmap, quem chama lê o arquivo de outra forma)
+    bool abrir(const std::string& arquivo, bool sequencial) {
+        fechar();
+#ifndef _WIN32
+        int fd = open(arquivo.c_str(), O_RDONLY);
+        if(fd < 0) return false;
+        struct stat st;
+        if(fstat(fd, &st) == 0 && st.st_size > 0) {
+            void* m = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if(m != MAP_FAILED) {
+                if(sequencial) madvise(m, st.st_size, MADV_SEQUENTIAL);
+                p = (const char*)m;
+                n = st.st_size;
+            }
+        }
+        ::close(fd);
+#else
+        (void)arquivo;
+        (void)sequencial;
+#endif
+        return p != nullptr;
+    }
+
+    void fechar() {
+#ifndef _WIN32
+        if(p) munmap((void*)p, n);
+#endif
+        p = nullptr;
+        n = 0;
+    }
+
+    const char* dados() const { return p; }
+    size_t tamanho() const { return n; }
+};
+
+/* Leitor de programas em streaming. O arquivo é mapeado em memória (ou, para
+   "-", a entrada padrão é lida em blocos) e cada linha é analisada no próprio
+   buffer por um tokenizador escrito à mão, sem cópias intermediárias. Erros
+   são reportados com o número da linha em vez de encerrar o programa. */
+class LeitorPrograma {
+private:
+    std::string nome;
+    const char* dados = nullptr;   // buffer atual (mapeamento ou bloco lido)
+    size_t tamanho = 0;
+    size_t pos = 0;
+    ArquivoMapeado mapa;
+    std::vector<char> bloco;            // usado para stdin e quando não há mmap
+    FILE* entrada = nullptr;
+    bool fim_entrada = true;
+    int num_linha = 0;
+    std::string msg_erro;
+    
+    // Rótulos e desvios só quando o programa inteiro vai para a memória
+    bool rotulos_permitidos = false;
+    int num_instr = 0;
+    std::unordered_map<std::string, int> rotulos;
+
+    static constexpr size_t TAM_BLOCO = 1 << 16;
+
+    // Lê mais um bloco da entrada, preservando a linha incompleta do final
+    bool recarregar() {
+        if(fim_entrada) return false;
+        size_t resto = tamanho - pos;
+        memmove(bloco.data(), bloco.data() + pos, resto);
+        if(bloco.size() < resto + TAM_BLOCO) bloco.resize(resto + TAM_BLOCO);
+        size_t lidos = fread(bloco.data() + resto, 1, TAM_BLOCO, entrada);
+        if(lidos == 0) fim_entrada = true;
+        dados = bloco.data();
+        tamanho = resto + lidos;
+        pos = 0;
+        return lidos > 0;
+    }
+
+    // Próxima linha bruta em [ini, fim); false no fim da entrada
+    bool proxima_linha(const char*& ini, const char*& fim) {
+        while(true) {
+            const char* p = dados + pos;
+            const char* nl = (const char*)memchr(p, '\n', tamanho - pos);
+            if(nl) {
+                ini = p;
+                fim = nl;
+                pos = nl - dados + 1;
+                num_linha++;
+                return true;
+            }
+            if(!recarregar()) {
+                if(pos >= tamanho) return false;
+                // Última linha sem '\n'
+                ini = dados + pos;
+                fim = dados + tamanho;
+                pos = tamanho;
+                num_linha++;
+                return true;
+            }
+        }
+    }
+
+    bool erro_abertura() {
+        msg_erro = "Erro ao abrir arquivo: " + nome;
+        return false;
+    }
+
+    bool falhar(const std::string& msg) {
+        msg_erro = nome + ":" + std::to_string(num_linha) + ": " + msg;
+        return false;
+    }
+
+    static constexpr const char* ERRO_STREAMING =
+        "rotulos e desvios exigem o programa inteiro em memoria (use um arquivo, nao a entrada padrao)";
+
+    static void pular_espacos(const char*& p, const char* fim) {
+        while(p < fim && isspace((unsigned char)*p)) p++;
+    }
+
+    bool ler_virgula(const char*& p, const char* fim) {
+        pular_espacos(p, fim);
+        if(p >= fim || *p != ',') return falhar("esperava ','");
+        p++;
+        return true;
+    }
+
+    bool ler_registrador(const char*& p, const char* fim, int8_t& reg) {
+        pular_espacos(p, fim);
+        if(p >= fim || tolower((unsigned char)*p) != 'r') return falhar("esperava registrador (R0-R31)");
+        p++;
+        int v = 0, digitos = 0;
+        while(p < fim && isdigit((unsigned char)*p) && digitos < 4) {
+            v = v * 10 + (*p++ - '0');
+            digitos++;
+        }
+        if(digitos == 0 || v >= REGISTRADORES) return falhar("registrador invalido");
+        reg = v;
+        return true;
+    }
+
+    bool ler_imediato(const char*& p, const char* fim, int& imm) {
+        pular_espacos(p, fim);
+        bool negativo = false;
+        if(p < fim && (*p == '-' || *p == '+')) negativo = *p++ == '-';
+        long long v = 0;
+        int digitos = 0;
+        while(p < fim && isdigit((unsigned char)*p)) {
+            v = v * 10 + (*p++ - '0');
+            if(v > (long long)INT32_MAX + negativo) return falhar("imediato fora do intervalo");
+            digitos++;
+        }
+        if(digitos == 0) return falhar("esperava valor imediato");
+        imm = (int)(negativo ? -v : v);
+        return true;
+    }
+
+    // Operando de memória: "imm" (sem base), "desl(Rb)" ou "(Rb)"
+    bool ler_endereco(const char*& p, const char* fim, int& desl, int8_t& base) {
+        pular_espacos(p, fim);
+        desl = 0;
+        base = SEM_BASE;
+        if(p < fim && *p != '(' && !ler_imediato(p, fim, desl)) return false;
+        pular_espacos(p, fim);
+        if(p >= fim || *p != '(') return true;
+        p++;
+        if(!ler_registrador(p, fim, base)) return false;
+        pular_espacos(p, fim);
+        if(p >= fim || *p != ')') return falhar("esperava ')'");
+        p++;
+        return true;
+    }
+
+    static bool caractere_rotulo(char c) {
+        return isalnum((unsigned char)c) || c == '_' || c == '.';
+    }
+
+    // Alvo de desvio: rótulo ou índice da instrução. Rótulos ainda não vistos
+    // ficam pendentes e são resolvidos no fim da leitura (resolver_rotulos)
+    bool ler_alvo(const char*& p, const char* fim, int32_t& alvo) {
+        pular_espacos(p, fim);
+        if(p < fim && isdigit((unsigned char)*p)) return ler_imediato(p, fim, alvo);
+        const char* ini = p;
+        while(p < fim && caractere_rotulo(*p)) p++;
+        if(p == ini) return falhar("esperava rotulo");
+        std::string nome_rotulo(ini, p);
+        auto it = rotulos.find(nome_rotulo);
+        if(it != rotulos.end()) alvo = it->second;
+        else {
+            alvo = -1;
+            pendencias.push_back({ num_instr, nome_rotulo, num_linha });
+        }
+        return true;
+    }
+
+    // Compara o mnemônico [p, fim) com 'nome' (minúsculo), sem diferenciar caixa
+    static bool mnemonico_igual(const char* p, const char* fim, const char* nome) {
+        for(; p < fim && *nome; p++, nome++) {
+            if(tolower((unsigned char)*p) != *nome) return false;
+        }
+        return p == fim && *nome == 0;
+    }
+
+    static bool parse_op(const char* p, const char* fim, TipoOp& op) {
+        if(mnemonico_igual(p, fim, "add")) op = TipoOp::ADD;
+        else if(mnemonico_igual(p, fim, "sub")) op = TipoOp::SUB;
+        else if(mnemonico_igual(p, fim, "mul")) op = TipoOp::MUL;
+        else if(mnemonico_igual(p, fim, "div")) op = TipoOp::DIV;
+        else if(mnemonico_igual(p, fim, "ld") || mnemonico_igual(p, fim, "lda") ||
+                mnemonico_igual(p, fim, "li")) op = TipoOp::LD;
+        else if(mnemonico_igual(p, fim, "st") || mnemonico_igual(p, fim, "sd")) op = TipoOp::ST;
+        else if(mnemonico_igual(p, fim, "beq")) op = TipoOp::BEQ;
+        else if(mnemonico_igual(p, fim, "bne")) op = TipoOp::BNE;
+        else if(mnemonico_igual(p, fim, "j")) op = TipoOp::J;
+        else return false;
+        return true;
+    }
+
+public:
+    struct Pendencia {
+        int indice;         // instrução de desvio
+        std::string rotulo;
+        int linha;
+    };
+    std::vector<Pendencia> pendencias;
+
+    ~LeitorPrograma() { fechar(); }
+
+    void permitir_rotulos() { rotulos_permitidos = true; }
+
+    // Índice da instrução marcada pelo rótulo, ou -1 se não foi definido
+    int buscar_rotulo(const std::string& rotulo) const {
+        auto it = rotulos.find(rotulo);
+        return it == rotulos.end() ? -1 : it->second;
+    }
+
+    std::string erro_rotulo(const Pendencia& pd) const {
+        return nome + ":" + std::to_string(pd.linha) + ": rotulo indefinido '" + pd.rotulo + "'";
+    }
+
+    // Abre um arquivo de programa; "-" lê da entrada padrão
+    bool abrir(const std::string& arquivo) {
+        fechar();
+        nome = arquivo;
+        num_linha = 0;
+        num_instr = 0;
+        rotulos.clear();
+        pendencias.clear();
+        msg_erro.clear();
+        
+        if(arquivo == "-") {
+            entrada = stdin;
+        } else {
+            if(mapa.abrir(arquivo, true)) {
+                dados = mapa.dados();
+                tamanho = mapa.tamanho();
+                pos = 0;
+                return true;
+            }
+            entrada = fopen(arquivo.c_str(), "rb");
+            if(!entrada) return erro_abertura();
+        }
+        fim_entrada = false;
+        bloco.assign(TAM_BLOCO, 0);
+        dados = bloco.data();
+        tamanho = pos = 0;
+        return true;
+    }
+
+    void fechar() {
+        mapa.fechar();
+        if(entrada && entrada != stdin) fclose(entrada);
+        entrada = nullptr;
+        dados = nullptr;
+        tamanho = pos = 0;
+        fim_entrada = true;
+    }
+
+    const std::string& erro() const { return msg_erro; }
+
+    // Lê a próxima instrução e seu texto; retorna false no fim do arquivo ou
+    // em erro (nesse caso erro() não fica vazio)
+    bool proxima(Instr& ins, std::string& texto) {
+        const char* ini;
+        const char* fim;
+        while(proxima_linha(ini, fim)) {
+            // trim
+            while(ini < fim && isspace((unsigned char)*ini)) ini++;
+            while(fim > ini && isspace((unsigned char)fim[-1])) fim--;
+            if(ini == fim || *ini == '#') continue;
+            // '#' depois de espaço inicia um comentário até o fim da linha
+            for(const char* c = ini + 1; c < fim; c++) {
+                if(*c == '#' && isspace((unsigned char)c[-1])) {
+                    fim = c;
+                    while(isspace((unsigned char)fim[-1])) fim--;
+                    break;
+                }
+            }
+            
+            // Rótulo no início da linha ("laco:"), sozinho ou antes da instrução
+            const char* p = ini;
+            while(p < fim && caractere_rotulo(*p)) p++;
+            if(p < fim && p > ini && *p == ':') {
+                if(!rotulos_permitidos) return falhar(ERRO_STREAMING);
+                if(!rotulos.emplace(std::string(ini, p), num_instr).second) {
+                    return falhar("rotulo duplicado '" + std::string(ini, p) + "'");
+                }
+                ini = p + 1;
+                pular_espacos(ini, fim);
+                if(ini == fim || *ini == '#') continue;
+            }
+            
+            ins = Instr();
+            texto.assign(ini, fim);
+            
+            p = ini;
+            while(p < fim && !isspace((unsigned char)*p)) p++;
+            if(!parse_op(ini, p, ins.tipo)) {
+                return falhar("instrucao desconhecida '" + std::string(ini, p) + "'");
+            }
+            if(eh_desvio(ins.tipo) && !rotulos_permitidos) return falhar(ERRO_STREAMING);
+            
+            bool ok;
+            // Aritméticas: OP Rd, Rs, Rt
+            if(ins.tipo == TipoOp::ADD || ins.tipo == TipoOp::SUB ||
+               ins.tipo == TipoOp::MUL || ins.tipo == TipoOp::DIV) {
+                ok = ler_registrador(p, fim, ins.dest) && ler_virgula(p, fim) &&
+                     ler_registrador(p, fim, ins.src1) && ler_virgula(p, fim) &&
+                     ler_registrador(p, fim, ins.src2);
+            }
+            // Load: LD Rd, imm (carregamento imediato) ou LD Rd, desl(Rb)
+            else if(ins.tipo == TipoOp::LD) {
+                ok = ler_registrador(p, fim, ins.dest) && ler_virgula(p, fim) &&
+                     ler_endereco(p, fim, ins.imm, ins.src2);
+            }
+            // Store: ST Rs, endereço ou ST Rs, desl(Rb)
+            else if(ins.tipo == TipoOp::ST) {
+                ok = ler_registrador(p, fim, ins.src1) && ler_virgula(p, fim) &&
+                     ler_endereco(p, fim, ins.imm, ins.src2);
+            }
+            // Desvios condicionais: BEQ/BNE Rs, Rt, alvo
+            else if(ins.tipo != TipoOp::J) {
+                ok = ler_registrador(p, fim, ins.src1) && ler_virgula(p, fim) &&
+                     ler_registrador(p, fim, ins.src2) && ler_virgula(p, fim) &&
+                     ler_alvo(p, fim, ins.imm);
+            }
+            // Desvio incondicional: J alvo
+            else {
+                ok = ler_alvo(p, fim, ins.imm);
+            }
+            if(!ok) return false;
+            
+            pular_espacos(p, fim);
+            if(p != fim) return falhar("texto inesperado apos a instrucao");
+            num_instr++;
+            return true;
+        }
+        return false;
+    }
+};
+
+// FNV-1a de 64 bits; identifica o arquivo-fonte no cache de imagens
+inline uint64_t hash_bytes(const char* p, size_t n, uint64_t h = 0xcbf29ce484222325ULL) {
+    for(size_t i = 0; i < n; i++) {
+        h ^= (unsigned char)p[i];
+        h *= 0x100000001b3ULL;
+    }
+    return h;
+}
+
+inline bool hash_arquivo(const std::string& arquivo, uint64_t& h) {
+    ArquivoMapeado mapa;
+    if(mapa.abrir(arquivo, true)) {
+        h = hash_bytes(mapa.dados(), mapa.tamanho());
+        return true;
+    }
+    FILE* f = fopen(arquivo.c_str(), "rb");
+    if(!f) return false;
+    std::vector<char> bloco(1 << 16);
+    h = hash_bytes(nullptr, 0);
+    size_t lidos;
+    while((lidos = fread(bloco.data(), 1, bloco.size(), f)) > 0) h = hash_bytes(bloco.data(), lidos, h);
+    fclose(f);
+    return true;
+}
+
+/* Imagem binária de um programa já montado. Formato (ordem de bytes do
+   hospedeiro):
+     CabecalhoImagem | num_instr registros Instr de 12 bytes
+     | tabela de textos (cada um terminado em '\0')
+   A imagem é mapeada em memória e a janela de busca lê os registros direto
+   do mapeamento, sem analisar texto nem copiar instruções. */
+constexpr uint32_t VERSAO_IMAGEM = 3;
+
+struct CabecalhoImagem {
+    char magica[4];         // "TOMP"
+    uint32_t versao;
+    uint64_t hash_fonte;    // hash do arquivo-fonte (chave do cache)
+    uint64_t num_instr;
+    uint64_t tam_textos;
+};
+
+// Texto de uma instrução no formato aceito pelo leitor
+inline std::string formatar_instr(const Instr& ins) {
+    char texto[48];
+    switch(ins.tipo) {
+        case TipoOp::LD:
+        case TipoOp::ST:
+            if(ins.src2 == SEM_BASE) {
+                snprintf(texto, sizeof(texto), "%s R%d, %d", NOMES_OP[(int)ins.tipo],
+                         ins.tipo == TipoOp::LD ? ins.dest : ins.src1, ins.imm);
+            } else {
+                snprintf(texto, sizeof(texto), "%s R%d, %d(R%d)", NOMES_OP[(int)ins.tipo],
+                         ins.tipo == TipoOp::LD ? ins.dest : ins.src1, ins.imm, ins.src2);
+            }
+            break;
+        case TipoOp::BEQ:
+        case TipoOp::BNE:
+            snprintf(texto, sizeof(texto), "%s R%d, R%d, %d", NOMES_OP[(int)ins.tipo],
+                     ins.src1, ins.src2, ins.imm);
+            break;
+        case TipoOp::J:
+            snprintf(texto, sizeof(texto), "J %d", ins.imm);
+            break;
+        default:
+            snprintf(texto, sizeof(texto), "%s R%d, R%d, R%d", NOMES_OP[(int)ins.tipo],
+                     ins.dest, ins.src1, ins.src2);
+    }
+    return texto;
+}
+
+// Acumula instruções e seus textos para montar uma imagem em memória (a
+// partir do fonte ou de programas gerados pelo próprio simulador). Textos
+// repetidos entram uma vez só na tabela: programas longos repetem poucas
+// centenas de milhares de linhas distintas, e a imagem fica menor que o fonte.
+class MontadorPrograma {
+private:
+    std::vector<Instr> lista;
+    std::string tabela;
+    std::unordered_map<std::string, uint32_t> posicoes;   // texto -> deslocamento na tabela
+    friend class ImagemPrograma;
+
+public:
+    void adicionar(Instr ins, const std::string& texto) {
+        auto it = posicoes.find(texto);
+        if(it == posicoes.end()) {
+            it = posicoes.emplace(texto, (uint32_t)tabela.size()).first;
+            tabela.append(texto.c_str(), texto.size() + 1);
+        }
+        ins.texto = it->second;
+        lista.push_back(ins);
+    }
+
+    void adicionar(const Instr& ins) { adicionar(ins, formatar_instr(ins)); }
+
+    void definir_alvo(size_t i, int alvo) { lista[i].imm = alvo; }
+
+    size_t tamanho() const { return lista.size(); }
+};
+
+// Registradores usados pela instrução dentro de R0-R31 (a base de LD/ST
+// pode faltar); rejeita também operações desconhecidas
+inline bool registradores_validos(const Instr& ins) {
+    auto reg = [](int r) { return r >= 0 && r < REGISTRADORES; };
+    switch(ins.tipo) {
+        case TipoOp::ADD: case TipoOp::SUB: case TipoOp::MUL: case TipoOp::DIV:
+            return reg(ins.dest) && reg(ins.src1) && reg(ins.src2);
+        case TipoOp::LD: return reg(ins.dest) && (ins.src2 == SEM_BASE || reg(ins.src2));
+        case TipoOp::ST: return reg(ins.src1) && (ins.src2 == SEM_BASE || reg(ins.src2));
+        case TipoOp::BEQ: case TipoOp::BNE: return reg(ins.src1) && reg(ins.src2);
+        case TipoOp::J: return true;
+        default: return false;
+    }
+}
+
+class ImagemPrograma {
+private:
+    ArquivoMapeado mapa;
+    std::vector<char> bytes;     // imagem montada em memória (ou lida sem mmap)
+    const CabecalhoImagem* cab = nullptr;
+    const Instr* instr = nullptr;
+    const char* textos = nullptr;
+
+    bool validar(const char* p, size_t n) {
+        if(n < sizeof(CabecalhoImagem)) return false;
+        const CabecalhoImagem* c = (const CabecalhoImagem*)p;
+        if(memcmp(c->magica, "TOMP", 4) != 0 || c->versao != VERSAO_IMAGEM) return false;
+        if(c->num_instr > (uint64_t)INT32_MAX) return false;
+        if(n != sizeof(CabecalhoImagem) + c->num_instr * sizeof(Instr) + c->tam_textos) return false;
+        if(c->tam_textos > 0 && p[n - 1] != '\0') return false;
+        cab = c;
+        instr = (const Instr*)(p + sizeof(CabecalhoImagem));
+        textos = (const char*)(instr + c->num_instr);
+        for(uint64_t i = 0; i < c->num_instr; i++) {
+            if(instr[i].texto >= c->tam_textos || !registradores_validos(instr[i])) return false;
+            if(eh_desvio(instr[i].tipo) && (instr[i].imm < 0 || (uint64_t)instr[i].imm > c->num_instr)) return false;
+        }
+        return true;
+    }
+
+public:
+    ImagemPrograma() = default;
+    ImagemPrograma(const ImagemPrograma&) = delete;
+    ImagemPrograma& operator=(const ImagemPrograma&) = delete;
+
+    static bool eh_imagem(const std::string& arquivo) {
+        char magica[4];
+        FILE* f = fopen(arquivo.c_str(), "rb");
+        if(!f) return false;
+        bool ok = fread(magica, 1, 4, f) == 4 && memcmp(magica, "TOMP", 4) == 0;
+        fclose(f);
+        return ok;
+    }
+
+    // Abre uma imagem gravada por gravar()
+    bool abrir(const std::string& arquivo, std::string& erro) {
+        if(mapa.abrir(arquivo, false)) {
+            if(validar(mapa.dados(), mapa.tamanho())) return true;
+        } else {
+            FILE* f = fopen(arquivo.c_str(), "rb");
+            if(!f) {
+                erro = "Erro ao abrir arquivo: " + arquivo;
+                return false;
+            }
+            bytes.clear();
+            char bloco[1 << 14];
+            size_t lidos;
+            while((lidos = fread(bloco, 1, sizeof(bloco), f)) > 0) bytes.insert(bytes.end(), bloco, bloco + lidos);
+            fclose(f);
+            if(validar(bytes.data(), bytes.size())) return true;
+        }
+        erro = arquivo + ": imagem de programa invalida ou de outra versao";
+        return false;
+    }
+
+    // Monta a imagem em memória a partir do fonte em texto
+    bool montar(const std::string& fonte, std::string& erro) {
+        uint64_t h = 0;
+        if(fonte != "-" && !hash_arquivo(fonte, h)) {
+            erro = "Erro ao abrir arquivo: " + fonte;
+            return false;
+        }
+        LeitorPrograma leitor;
+        if(!leitor.abrir(fonte)) {
+            erro = leitor.erro();
+            return false;
+        }
+        leitor.permitir_rotulos();
+        MontadorPrograma montador;
+        std::string texto;
+        Instr ins;
+        while(leitor.proxima(ins, texto)) montador.adicionar(ins, texto);
+        if(!leitor.erro().empty()) {
+            erro = leitor.erro();
+            return false;
+        }
+        for(const auto& pd : leitor.pendencias) {
+            int alvo = leitor.buscar_rotulo(pd.rotulo);
+            if(alvo < 0) {
+                erro = leitor.erro_rotulo(pd);
+                return false;
+            }
+            montador.definir_alvo(pd.indice, alvo);
+        }
+        montar(montador, h);
+        return true;
+    }
+
+    // Monta a imagem em memória a partir de instruções já decodificadas. Sem
+    // o hash do fonte (programas gerados), o hash é o das próprias instruções
+    void montar(const MontadorPrograma& montador, uint64_t h = 0) {
+        const std::vector<Instr>& lista = montador.lista;
+        const std::string& tabela = montador.tabela;
+        if(h == 0) {
+            h = hash_bytes((const char*)lista.data(), lista.size() * sizeof(Instr));
+            h = hash_bytes(tabela.data(), tabela.size(), h);
+        }
+        CabecalhoImagem c = {};
+        memcpy(c.magica, "TOMP", 4);
+        c.versao = VERSAO_IMAGEM;
+        c.hash_fonte = h;
+        c.num_instr = lista.size();
+        c.tam_textos = tabela.size();
+        bytes.resize(sizeof(c) + lista.size() * sizeof(Instr) + tabela.size());
+        memcpy(bytes.data(), &c, sizeof(c));
+        if(!lista.empty()) memcpy(bytes.data() + sizeof(c), lista.data(), lista.size() * sizeof(Instr));
+        if(!tabela.empty()) memcpy(bytes.data() + sizeof(c) + lista.size() * sizeof(Instr), tabela.data(), tabela.size());
+        mapa.fechar();
+        validar(bytes.data(), bytes.size());
+    }
+
+    // Grava a imagem; o arquivo só aparece completo (rename) para que leitores
+    // concorrentes do cache nunca vejam uma imagem pela metade
+    bool gravar(const std::string& arquivo) const {
+        const char* p = (const char*)cab;
+        size_t n = sizeof(CabecalhoImagem) + cab->num_instr * sizeof(Instr) + cab->tam_textos;
+        std::string temp = arquivo + ".tmp" + std::to_string((uintptr_t)this);
+        FILE* f = fopen(temp.c_str(), "wb");
+        if(!f) return false;
+        bool ok = fwrite(p, 1, n, f) == n;
+        ok = fclose(f) == 0 && ok;
+        if(ok) ok = rename(temp.c_str(), arquivo.c_str()) == 0;
+        if(!ok) remove(temp.c_str());
+        return ok;
+    }
+
+    int tamanho() const { return (int)cab->num_instr; }
+    uint64_t hash_fonte() const { return cab->hash_fonte; }
+    const Instr* instrucoes() const { return instr; }
+    const char* texto(int idx) const { return textos + instr[idx].texto; }
+};
+
+// Programas com rótulos ou desvios não podem ser lidos em streaming (um desvio
+// para trás volta a instruções já descartadas da janela): procura ':' ou uma
+// linha começando por B/J no arquivo mapeado
+inline bool exige_programa_inteiro(const std::string& arquivo) {
+    ArquivoMapeado mapa;
+    if(!mapa.abrir(arquivo, true)) return false;
+    const char* p = mapa.dados();
+    const char* fim = p + mapa.tamanho();
+    if(memchr(p, ':', fim - p)) return true;
+    while(p < fim) {
+        while(p < fim && (*p == ' ' || *p == '\t')) p++;
+        if(p < fim && (tolower((unsigned char)*p) == 'b' || tolower((unsigned char)*p) == 'j')) return true;
+        const char* nl = (const char*)memchr(p, '\n', fim - p);
+        if(!nl) break;
+        p = nl + 1;
+    }
+    return false;
+}
+
+// Cria o diretório (um nível, como mkdir); true também se ele já existia
+inline bool criar_diretorio(const std::string& dir) {
+#ifndef _WIN32
+    if(mkdir(dir.c_str(), 0777) == 0) return true;
+    struct stat st;
+    return errno == EEXIST && stat(dir.c_str(), &st) == 0 && S_ISDIR(st.st_mode);
+#else
+    return _mkdir(dir.c_str()) == 0 || errno == EEXIST;
+#endif
+}
+
+// Imagem de um programa: o próprio arquivo, se já for uma imagem; senão a
+// imagem do cache com o hash do fonte (montada e gravada no cache na primeira
+// vez) ou, sem diretório de cache, montada só em memória
+inline std::shared_ptr<const ImagemPrograma> carregar_imagem(const std::string& arquivo, const std::string& dir_cache, std::string& erro) {
+    auto img = std::make_shared<ImagemPrograma>();
+    if(arquivo != "-" && ImagemPrograma::eh_imagem(arquivo)) {
+        if(!img->abrir(arquivo, erro)) return nullptr;
+        return img;
+    }
+    if(dir_cache.empty() || arquivo == "-") {
+        if(!img->montar(arquivo, erro)) return nullptr;
+        return img;
+    }
+    
+    uint64_t h;
+    if(!hash_arquivo(arquivo, h)) {
+        erro = "Erro ao abrir arquivo: " + arquivo;
+        return nullptr;
+    }
+    if(!criar_diretorio(dir_cache)) {
+        erro = "Erro ao criar o diretorio de cache: " + dir_cache;
+        return nullptr;
+    }
+    char nome[32];
+    snprintf(nome, sizeof(nome), "/%016llx.tpb", (unsigned long long)h);
+    std::string caminho = dir_cache + nome;
+    std::string ignorado;
+    if(img->abrir(caminho, ignorado) && img->hash_fonte() == h) return img;
+    
+    img = std::make_shared<ImagemPrograma>();
+    if(!img->montar(arquivo, erro)) return nullptr;
+    // O diretório existe; uma falha de gravação (cache só de leitura, disco
+    // cheio) não impede a simulação, só faz a próxima carga montar de novo
+    img->gravar(caminho);
+    return img;
+}
+
+/* Janela de busca: as instruções de [base, base + n) ficam num buffer
+   circular, da mais antiga ainda em voo (cabeça do ROB) até a última lida.
+   Instruções já consolidadas são descartadas, então um programa lido em
+   streaming ocupa memória proporcional ao ROB, não ao tamanho do arquivo.
+   Alternativamente, a janela pode apontar para a imagem de um programa já
+   montado, que é lida direto, sem buffer circular. */
+class JanelaBusca {
+private:
+    std::unique_ptr<LeitorPrograma> fonte;
+    std::shared_ptr<const ImagemPrograma> imagem;
+    std::string arquivo_fonte;   // lido em streaming
+    std::string msg_erro;
+    std::vector<Instr> anel;          // capacidade potência de 2
+    std::vector<std::string> textos;  // textos das instruções do anel, mesma posição
+    int base = 0;                     // índice da instrução mais antiga do anel
+    int n = 0;                        // instruções no anel
+    bool esgotada = true;
+
+    static constexpr size_t TEXTO_RESERVADO = 48;
+
+    // Dobra a capacidade; a instrução idx fica sempre na posição idx % capacidade
+    void crescer() {
+        size_t cap = std::max<size_t>(anel.size() * 2, 64);
+        std::vector<Instr> novo(cap);
+        std::vector<std::string> novos_textos(cap);
+        // Espaço reservado para que a leitura de linhas comuns não aloque
+        for(std::string& t : novos_textos) t.reserve(TEXTO_RESERVADO);
+        for(int i = base; i < base + n; i++) {
+            novo[i & (cap - 1)] = anel[i & (anel.size() - 1)];
+            novos_textos[i & (cap - 1)].swap(textos[i & (anel.size() - 1)]);
+        }
+        anel.swap(novo);
+        textos.swap(novos_textos);
+    }
+
+    // Lê mais uma instrução da fonte para o fim do anel
+    bool buscar_mais() {
+        if(esgotada) return false;
+        if(n == (int)anel.size()) crescer();
+        size_t k = (base + n) & (anel.size() - 1);
+        if(!fonte->proxima(anel[k], textos[k])) {
+            esgotada = true;
+            return false;
+        }
+        n++;
+        return true;
+    }
+
+public:
+    void definir_programa(std::shared_ptr<const ImagemPrograma> img) {
+        imagem = std::move(img);
+        fonte.reset();
+        msg_erro.clear();
+        esgotada = true;
+        base = n = 0;
+    }
+
+    // Abre o programa. Imagens binárias (e fontes com cache de imagens ou com
+    // desvios, montadas em memória) são usadas inteiras; fontes em texto são lidas em streaming, já com até
+    // 'antecipar' instruções, para que programas pequenos fiquem inteiros na
+    // janela e o total seja conhecido desde o início
+    bool abrir(const std::string& arquivo, int antecipar, const std::string& dir_cache) {
+        imagem.reset();
+        fonte.reset();
+        msg_erro.clear();
+        base = n = 0;
+        esgotada = true;
+        if(arquivo != "-" && (!dir_cache.empty() || ImagemPrograma::eh_imagem(arquivo) ||
+                              exige_programa_inteiro(arquivo))) {
+            imagem = carregar_imagem(arquivo, dir_cache, msg_erro);
+            return imagem != nullptr;
+        }
+        arquivo_fonte = arquivo;
+        fonte.reset(new LeitorPrograma());
+        esgotada = !fonte->abrir(arquivo);
+        while(n < antecipar && buscar_mais()) {}
+        return erro().empty();
+    }
+
+    const std::string& erro() const {
+        return fonte ? fonte->erro() : msg_erro;
+    }
+
+    // Instrução de índice idx, ou nullptr depois do fim do programa
+    const Instr* obter(int idx) {
+        if(imagem) return idx < imagem->tamanho() ? &imagem->instrucoes()[idx] : nullptr;
+        while(idx >= base + n) {
+            if(!buscar_mais()) return nullptr;
+        }
+        return &anel[idx & (anel.size() - 1)];
+    }
+
+    // Texto da instrução idx ("" se já saiu da janela)
+    const char* texto(int idx) const {
+        if(imagem) return idx >= 0 && idx < imagem->tamanho() ? imagem->texto(idx) : "";
+        if(idx < base || idx >= base + n) return "";
+        return textos[idx & (anel.size() - 1)].c_str();
+    }
+
+    // Descarta as instruções anteriores a idx (já consolidadas)
+    void liberar_ate(int idx) {
+        if(imagem) return;
+        while(n > 0 && base < idx) {
+            base++;
+            n--;
+        }
+    }
+
+    // Total de instruções do programa, ou -1 se ainda não se chegou ao fim
+    int total() const {
+        if(imagem) return imagem->tamanho();
+        return esgotada ? base + n : -1;
+    }
+
+    // Índice da próxima instrução ainda não lida da fonte
+    int lidas() const {
+        return imagem ? imagem->tamanho() : base + n;
+    }
+
+    // Identifica o programa: o hash do fonte (o mesmo da imagem montada a
+    // partir dele), ou 0 se não há como calculá-lo (entrada padrão)
+    uint64_t hash_programa() const {
+        uint64_t h = 0;
+        if(imagem) return imagem->hash_fonte();
+        if(fonte && arquivo_fonte != "-" && !hash_arquivo(arquivo_fonte, h)) return 0;
+        return h;
+    }
+};
+
+// Índice do bit menos significativo ligado (x != 0)
+inline int ctz64(uint64_t x) {
+#if defined(__GNUC__) || defined(__clang__)
+    return __builtin_ctzll(x);
+#else
+    int n = 0;
+    while(!(x & 1)) { x >>= 1; n++; }
+    return n;
+#endif
+}
+
+inline int popcount64(uint64_t x) {
+#if defined(__GNUC__) || defined(__clang__)
+    return __builtin_popcountll(x);
+#else
+    int n = 0;
+    for(; x; x &= x - 1) n++;
+    return n;
+#endif
+}
+
+// Arranjo com tamanho fixado na compilação (N > 0) ou escolhido em tempo de
+// execução (N = 0). Com N fixo os laços das estruturas têm limite constante e
+// o compilador os desenrola; assign() só preenche, o tamanho já é N.
+template<class T, size_t N>
+struct Arranjo : std::array<T, N> {
+    void assign(size_t, const T& v) { this->fill(v); }
+};
+
+template<class T>
+struct Arranjo<T, 0> : std::vector<T> {};
+
+// Conjunto de n bits guardado em palavras de 64 bits. Busca de slot livre e
+// iteração sobre bits ligados usam ctz, uma palavra (64 entradas) por vez.
+// N > 0 fixa o número de bits na compilação.
+template<size_t N = 0>
+struct Mascara {
+    Arranjo<uint64_t, (N + 63) / 64> p;
+    size_t n = N;
+
+    size_t tam() const { return N ? N : n; }
+
+    void redimensionar(size_t tamanho) {
+        n = tamanho;
+        p.assign((tamanho + 63) / 64, 0);
+    }
+
+    bool testar(size_t i) const { return (p[i >> 6] >> (i & 63)) & 1; }
+    void ligar(size_t i) { p[i >> 6] |= uint64_t(1) << (i & 63); }
+    void desligar(size_t i) { p[i >> 6] &= ~(uint64_t(1) << (i & 63)); }
+    void definir(size_t i, bool b) { if(b) ligar(i); else desligar(i); }
+
+    bool vazia() const {
+        uint64_t acc = 0;
+        for(uint64_t w : p) acc |= w;
+        return acc == 0;
+    }
+
+    int contar() const {
+        int total = 0;
+        for(uint64_t w : p) total += popcount64(w);
+        return total;
+    }
+
+    // Quantos bits estão ligados aqui e desligados em 'outra'
+    int contar_sem(const Mascara& outra) const {
+        int total = 0;
+        for(size_t w = 0; w < p.size(); w++) total += popcount64(p[w] & ~outra.p[w]);
+        return total;
+    }
+
+    // Índice do primeiro bit desligado, ou -1 se os n bits estão ligados
+    int primeiro_livre() const {
+        for(size_t w = 0; w < p.size(); w++) {
+            uint64_t livres = ~p[w];
+            if(livres) {
+                size_t i = w * 64 + ctz64(livres);
+                return i < tam() ? (int)i : -1;
+            }
+        }
+        return -1;
+    }
+
+    // Chama f(i) para cada bit ligado, em ordem crescente de índice
+    template<class F>
+    void para_cada(F&& f) const {
+        for(size_t w = 0; w < p.size(); w++) {
+            for(uint64_t bits = p[w]; bits; bits &= bits - 1) {
+                f(w * 64 + ctz64(bits));
+            }
+        }
+    }
+
+    // Redefine os n bits a partir de um predicado por índice, sem desvios e
+    // sem alocar (reaproveita as palavras já existentes)
+    template<class Pred>
+    void preencher(Pred&& pred) {
+        for(uint64_t& w : p) w = 0;
+        for(size_t i = 0; i < tam(); i++) {
+            p[i >> 6] |= uint64_t(pred(i) ? 1 : 0) << (i & 63);
+        }
+    }
+};
+
+// Difusão do CDB sobre dois pares (valor, tag) de um banco: onde a tag casa,
+// copia o valor e zera a tag. As máscaras no lugar de ?: e os ponteiros
+// __restrict (respeitados em parâmetros) deixam o laço vetorizar já em -O2.
+inline void capturar_cdb(int* __restrict v1, int* __restrict q1,
+                         int* __restrict v2, int* __restrict q2,
+                         size_t n, int tag, int valor) {
+    for(size_t i = 0; i < n; i++) {
+        int m1 = -int(q1[i] == tag);
+        int m2 = -int(q2[i] == tag);
+        v1[i] = (v1[i] & ~m1) | (valor & m1);
+        q1[i] &= ~m1;
+        v2[i] = (v2[i] & ~m2) | (valor & m2);
+        q2[i] &= ~m2;
+    }
+}
+
+/* Estações de reserva e buffers guardados como estrutura de arranjos: cada
+   campo quente é um arranjo contíguo e os bits ocupada/executando são
+   máscaras. Assim a difusão do CDB, o despertar e a busca por slot livre
+   viram laços sem desvios (vetorizáveis pelo compilador) e operações de
+   máscara, e o custo por ciclo cresce pouco com 64-256 entradas. N > 0 fixa
+   o número de entradas na compilação (ver FormaMaquina); N = 0 é o banco
+   dimensionado em tempo de execução. */
+template<size_t N>
+struct BancoUnidades {
+    size_t n = N;
+    Mascara<N> ocupada, executando;
+    Mascara<N> selecao;    // resultado de prontas()/terminadas(), reaproveitado a cada ciclo
+    Arranjo<TipoOp, N> op;
+    Arranjo<int, N> ciclosExecRestantes;
+    Arranjo<int, N> indice_rob;
+
+    size_t tamanho() const { return N ? N : n; }
+
+    void redimensionar(size_t n) {
+        this->n = n;
+        ocupada.redimensionar(n);
+        executando.redimensionar(n);
+        selecao.redimensionar(n);
+        op.assign(n, TipoOp::NOP);
+        ciclosExecRestantes.assign(n, 0);
+        indice_rob.assign(n, 0);
+    }
+
+    int livre() const { return ocupada.primeiro_livre(); }
+
+    // Menor número de ciclos restantes entre as unidades em execução
+    int menor_restante() const {
+        int menor = INT32_MAX;
+        for(size_t i = 0; i < tamanho(); i++) {
+            int r = executando.testar(i) ? ciclosExecRestantes[i] : INT32_MAX;
+            menor = r < menor ? r : menor;
+        }
+        return menor;
+    }
+
+    // Desconta n ciclos de todas as unidades em execução
+    void descontar(int n) {
+        for(size_t i = 0; i < tamanho(); i++) {
+            ciclosExecRestantes[i] -= executando.testar(i) ? n : 0;
+        }
+    }
+
+    // Unidades cuja execução terminou após o desconto deste ciclo
+    const Mascara<N>& terminadas() {
+        selecao.preencher([&](size_t i) {
+            return executando.testar(i) && ciclosExecRestantes[i] <= 0;
+        });
+        return selecao;
+    }
+
+    void liberar(size_t i) {
+        ocupada.desligar(i);
+        executando.desligar(i);
+    }
+};
+
+// Estações de reserva para operações aritméticas
+template<size_t N>
+struct BancoRS : BancoUnidades<N> {
+    Arranjo<int, N> Vj, Vk;
+    Arranjo<int, N> Qj, Qk;
+
+    void redimensionar(size_t n) {
+        BancoUnidades<N>::redimensionar(n);
+        Vj.assign(n, 0); Vk.assign(n, 0);
+        Qj.assign(n, 0); Qk.assign(n, 0);
+    }
+
+    // Estações ocupadas, paradas e com os dois operandos disponíveis
+    const Mascara<N>& prontas() {
+        this->selecao.preencher([&](size_t i) {
+            return this->ocupada.testar(i) && !this->executando.testar(i) && (Qj[i] | Qk[i]) == 0;
+        });
+        return this->selecao;
+    }
+
+    // Captura um resultado do CDB. Slots livres têm Qj = Qk = 0, que nunca
+    // casa com uma tag válida, então não é preciso testar 'ocupada'.
+    void capturar(int tag, int valor) {
+        capturar_cdb(Vj.data(), Qj.data(), Vk.data(), Qk.data(), this->tamanho(), tag, valor);
+    }
+};
+
+// Buffers para operações de memória (load/store). V/Q é o valor a gravar
+// (ST) ou o valor lido (LD); Vb/Qb é o registrador base quando o endereço é
+// desl(Rb) ('indireto'), e 'endereco' guarda o deslocamento ou o imediato.
+template<size_t N>
+struct BancoBuffers : BancoUnidades<N> {
+    Arranjo<int, N> endereco;
+    Arranjo<int, N> V;
+    Arranjo<int, N> Q;
+    Arranjo<int, N> Vb;
+    Arranjo<int, N> Qb;
+    Mascara<N> indireto;
+
+    void redimensionar(size_t n) {
+        BancoUnidades<N>::redimensionar(n);
+        endereco.assign(n, 0);
+        V.assign(n, 0);
+        Q.assign(n, 0);
+        Vb.assign(n, 0);
+        Qb.assign(n, 0);
+        indireto.redimensionar(n);
+    }
+
+    const Mascara<N>& prontas() {
+        this->selecao.preencher([&](size_t i) {
+            return this->ocupada.testar(i) && !this->executando.testar(i) && (Q[i] | Qb[i]) == 0;
+        });
+        return this->selecao;
+    }
+
+    void capturar(int tag, int valor) {
+        capturar_cdb(V.data(), Q.data(), Vb.data(), Qb.data(), this->tamanho(), tag, valor);
+    }
+};
+
+// Entrada do ROB (Reorder Buffer)
+struct EntradaROB {
+    bool ocupada = false;
+    TipoOp op = TipoOp::NOP;
+    int dest = -1;
+    bool pronta = false;
+    int valor = 0;
+    int indice_instr = -1;      // o texto sai da janela de busca por este índice
+    int thread = 0;             // SMT: thread de hardware dona da instrução
+    int endereco_mem = 0;
+    int valor_arm = 0;
+    
+    // Banco de registradores físicos: o registrador que recebe o resultado
+    // (que então não fica em 'valor') e o mapeado antes para dest, liberado
+    // no commit
+    int fisico = 0;
+    int fisico_anterior = 0;
+    
+    // Fila de cargas/armazenamentos: endereco_mem já é conhecido (ST) ou a
+    // carga já leu o valor (LD com desl(Rb)); fonte_arm é o ST de onde a
+    // carga recebeu o valor por encaminhamento (0 = memória)
+    bool endereco_pronto = false;
+    int fonte_arm = 0;
+    
+    // Desvios condicionais: previsão feita na emissão e resultado real
+    bool previsto_tomado = false;
+    bool tomado = false;
+    int indice_preditor = 0;
+    uint32_t historico_antes = 0;   // histórico global quando a instrução foi emitida
+};
+
+// Banco de registradores, também em arranjos paralelos
+struct BancoRegistradores {
+    std::array<int, REGISTRADORES> valor{};
+    std::array<int, REGISTRADORES> tag{};
+    // Valores consolidados: 'valor' recebe resultados ainda especulativos no
+    // CDB, então é daqui que ele é restaurado quando um desvio é descartado
+    std::array<int, REGISTRADORES> consolidado{};
+
+    void capturar(int tag_rob, int v) {
+        for(int i = 0; i < REGISTRADORES; i++) {
+            valor[i] = tag[i] == tag_rob ? v : valor[i];
+        }
+    }
+};
+
+/* Imagem inicial da memória de dados: palavras de 32 bits little-endian,
+   carregadas a partir do endereço 'base'. O arquivo é mapeado (sem mmap, é
+   lido inteiro) e só as páginas escritas pelo programa são copiadas. */
+struct ImagemMemoria {
+    ArquivoMapeado mapa;
+    std::vector<char> copia;
+    const char* dados = nullptr;
+    uint32_t base = 0;
+    uint32_t palavras = 0;
+
+    // Palavra no endereço e (absoluto), ou 0 fora da imagem
+    int ler(uint32_t e) const {
+        uint32_t i = e - base;
+        if(i >= palavras) return 0;
+        int32_t v;
+        memcpy(&v, dados + (size_t)i * 4, 4);
+        return v;
+    }
+};
+
+inline std::shared_ptr<const ImagemMemoria> carregar_imagem_memoria(const std::string& arquivo, uint32_t base, std::string& erro) {
+    auto img = std::make_shared<ImagemMemoria>();
+    size_t n = 0;
+    if(img->mapa.abrir(arquivo, false)) {
+        img->dados = img->mapa.dados();
+        n = img->mapa.tamanho();
+    } else {
+        std::ifstream f(arquivo, std::ios::binary);
+        if(!f) {
+            erro = "Erro ao abrir imagem de memoria: " + arquivo;
+            return nullptr;
+        }
+        img->copia.assign(std::istreambuf_iterator<char>(f), std::istreambuf_iterator<char>());
+        img->dados = img->copia.data();
+        n = img->copia.size();
+    }
+    if(n % 4 != 0 || n / 4 > (uint64_t)UINT32_MAX - base + 1) {
+        erro = "Imagem de memoria invalida (tamanho nao multiplo de 4 ou alem do espaco de enderecos): " + arquivo;
+        return nullptr;
+    }
+    img->base = base;
+    img->palavras = (uint32_t)(n / 4);
+    return img;
+}
+
+/* Memória de dados esparsa. O endereço (int) é tomado sem sinal, num espaço
+   de 32 bits; uma tabela de dois níveis leva à página, alocada na primeira
+   escrita (copiando a parte da imagem inicial que cair nela). Leituras de
+   páginas nunca escritas vêm da imagem ou valem 0, sem alocar nada. */
+class MemoriaPaginada {
+public:
+    using Pagina = std::array<int, PALAVRAS_PAGINA>;
+
+private:
+    static constexpr int BITS_TABELA = (32 - BITS_PAGINA) / 2;
+    static constexpr int BITS_DIRETORIO = 32 - BITS_PAGINA - BITS_TABELA;
+    using Tabela = std::array<std::unique_ptr<Pagina>, (1 << BITS_TABELA)>;
+
+    std::vector<std::unique_ptr<Tabela>> diretorio;
+    std::shared_ptr<const ImagemMemoria> imagem;
+    size_t paginas = 0;
+    size_t alocacoes = 0;
+
+    const Pagina* pagina_existente(uint32_t e) const {
+        const Tabela* t = diretorio[e >> (BITS_PAGINA + BITS_TABELA)].get();
+        return t ? (*t)[(e >> BITS_PAGINA) & ((1u << BITS_TABELA) - 1)].get() : nullptr;
+    }
+
+public:
+    // Com registrar_escritas, cada escrita (e cada palavra não-zero copiada
+    // da imagem para uma página nova) vai para 'escritas', que o trace esvazia
+    bool registrar_escritas = false;
+    std::vector<std::pair<uint32_t, int>> escritas;
+
+    MemoriaPaginada() : diretorio(1 << BITS_DIRETORIO) {}
+
+    void definir_imagem(std::shared_ptr<const ImagemMemoria> img) { imagem = std::move(img); }
+    uint32_t palavras_imagem() const { return imagem ? imagem->palavras : 0; }
+
+    int ler(uint32_t e) const {
+        const Pagina* p = pagina_existente(e);
+        if(p) return (*p)[e & (PALAVRAS_PAGINA - 1)];
+        return imagem ? imagem->ler(e) : 0;
+    }
+
+    // Página que contém o endereço e, alocada se ainda não existe
+    Pagina& pagina(uint32_t e) {
+        std::unique_ptr<Tabela>& t = diretorio[e >> (BITS_PAGINA + BITS_TABELA)];
+        if(!t) {
+            t = std::make_unique<Tabela>();
+            alocacoes++;
+        }
+        std::unique_ptr<Pagina>& p = (*t)[(e >> BITS_PAGINA) & ((1u << BITS_TABELA) - 1)];
+        if(!p) {
+            p = std::make_unique<Pagina>();
+            alocacoes++;
+            paginas++;
+            uint32_t inicio = e & ~(uint32_t)(PALAVRAS_PAGINA - 1);
+            for(int i = 0; i < PALAVRAS_PAGINA; i++) {
+                int v = imagem ? imagem->ler(inicio + i) : 0;
+                (*p)[i] = v;
+                if(registrar_escritas && v != 0) escritas.emplace_back(inicio + i, v);
+            }
+        }
+        return *p;
+    }
+
+    void escrever(uint32_t e, int v) {
+        pagina(e)[e & (PALAVRAS_PAGINA - 1)] = v;
+        if(registrar_escritas) escritas.emplace_back(e, v);
+    }
+
+    // Chama f(endereço inicial, página) para as páginas alocadas, em ordem
+    // crescente de endereço
+    template<class F>
+    void para_cada_pagina(F&& f) const {
+        for(size_t d = 0; d < diretorio.size(); d++) {
+            if(!diretorio[d]) continue;
+            const Tabela& t = *diretorio[d];
+            for(size_t i = 0; i < t.size(); i++) {
+                if(t[i]) f((uint32_t)(((d << BITS_TABELA) | i) << BITS_PAGINA), *t[i]);
+            }
+        }
+    }
+
+    size_t paginas_alocadas() const { return paginas; }
+    // Alocações no heap feitas pela memória (tabelas e páginas)
+    size_t alocacoes_feitas() const { return alocacoes; }
+
+    void limpar() {
+        for(auto& t : diretorio) t.reset();
+        paginas = 0;
+    }
+};
+
+inline void imprimir_memoria(const MemoriaPaginada& memoria) {
+    printf("\nMemoria (enderecos nao-zero nas paginas escritas):\n");
+    memoria.para_cada_pagina([&](uint32_t inicio, const MemoriaPaginada::Pagina& p) {
+        for(int i = 0; i < PALAVRAS_PAGINA; i++) {
+            if(p[i] != 0) printf("M[%d]=%d  ", (int)(inicio + i), p[i]);
+        }
+    });
+}
+
+/* Escritas de um núcleo ainda não aplicadas à memória compartilhada
+   (multinúcleo: durante um quantum, cada núcleo só vê as próprias escritas).
+   Tabela hash de endereçamento aberto, com capacidade fixa para o máximo de
+   escritas de um quantum, e a lista na ordem de consolidação. Esvaziar é
+   trocar de geração, sem varrer a tabela. */
+class BufferEscritas {
+private:
+    std::vector<uint32_t> enderecos;
+    std::vector<int> valores;
+    std::vector<uint32_t> geracoes;      // slot em uso se == geracao
+    uint32_t geracao = 1;
+    uint32_t mascara = 0;
+    std::vector<std::pair<uint32_t, int>> ordem;
+
+    uint32_t slot(uint32_t e) const { return (e * 2654435761u) & mascara; }
+
+public:
+    void dimensionar(size_t max_escritas) {
+        size_t n = 16;
+        while(n < 2 * max_escritas) n *= 2;
+        enderecos.assign(n, 0);
+        valores.assign(n, 0);
+        geracoes.assign(n, 0);
+        mascara = (uint32_t)(n - 1);
+        ordem.reserve(max_escritas);
+    }
+
+    void adicionar(uint32_t e, int v) {
+        uint32_t i = slot(e);
+        while(geracoes[i] == geracao && enderecos[i] != e) i = (i + 1) & mascara;
+        geracoes[i] = geracao;
+        enderecos[i] = e;
+        valores[i] = v;
+        ordem.emplace_back(e, v);
+    }
+
+    bool buscar(uint32_t e, int& v) const {
+        for(uint32_t i = slot(e); geracoes[i] == geracao; i = (i + 1) & mascara) {
+            if(enderecos[i] == e) {
+                v = valores[i];
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // Aplica as escritas à memória, na ordem em que foram consolidadas
+    void aplicar(MemoriaPaginada& memoria) {
+        for(const auto& [e, v] : ordem) memoria.escrever(e, v);
+        ordem.clear();
+        geracao++;
+    }
+};
+
+/* Preditor de desvios condicionais. ESTATICO prevê tomado só para desvios
+   para trás (laços); BIMODAL e GSHARE usam contadores saturados de 2 bits,
+   indexados pelo PC ou pelo PC xor o histórico global. O histórico é
+   atualizado na previsão (especulativo) e refeito a partir da entrada do
+   ROB quando a previsão se mostra errada; os contadores só mudam quando o
+   desvio é consolidado. */
+enum class TipoPreditor { ESTATICO, BIMODAL, GSHARE };
+
+const char* const NOMES_PREDITOR[] = { "estatico", "bimodal", "gshare" };
+
+struct PreditorDesvios {
+    TipoPreditor tipo = TipoPreditor::BIMODAL;
+    uint32_t mascara = 0;
+    std::vector<uint8_t> contadores;
+    uint32_t historico = 0;
+
+    void configurar(int t, int bits) {
+        tipo = (TipoPreditor)t;
+        mascara = (1u << bits) - 1;
+        contadores.assign(tipo == TipoPreditor::ESTATICO ? 0 : mascara + 1, 2);  // fracamente tomado
+        historico = 0;
+    }
+
+    int indice(int pc) const {
+        return (int)(((uint32_t)pc ^ (tipo == TipoPreditor::GSHARE ? historico : 0)) & mascara);
+    }
+
+    bool prever(int pc, int alvo, int idx) const {
+        if(tipo == TipoPreditor::ESTATICO) return alvo <= pc;
+        return contadores[idx] >= 2;
+    }
+
+    // Desloca a direção no histórico a partir de um histórico salvo
+    void registrar(uint32_t antes, bool tomado) {
+        historico = ((antes << 1) | (tomado ? 1 : 0)) & mascara;
+    }
+
+    void treinar(int idx, bool tomado) {
+        if(contadores.empty()) return;
+        uint8_t& c = contadores[idx];
+        if(tomado && c < 3) c++;
+        if(!tomado && c > 0) c--;
+    }
+};
+
+// Nível de saída do simulador
+enum class Verbosidade { NENHUMA, RESUMO, COMPLETA };
+
+/* Trace binário por ciclo.
+   Formato (inteiros em varint LEB128; valores com sinal em zigzag):
+     "TOMT" | versão (1 byte) | nº de parâmetros | parâmetros da máquina
+     | registros: delta de ciclo (>= 1)
+                  | nº de instruções lidas desde o registro anterior
+                  | para cada uma: tamanho + texto
+                  | nº de escritas na memória desde o registro anterior
+                  | para cada uma: endereço + valor
+                  | nº de campos alterados
+                  | para cada campo: delta de índice + novo valor
+     | 0 (fim) | total de ciclos
+   Os textos vão junto dos registros porque o programa é lido em streaming.
+   O estado é achatado num vetor de int (ver SimuladorTomasulo::visitar_estado);
+   cada registro guarda só os campos que mudaram desde o registro anterior.
+   A memória, esparsa, não cabe nesse vetor e vai como lista de escritas. */
+constexpr uint8_t VERSAO_TRACE = 4;
+
+class GravadorTrace {
+private:
+    FILE* f = nullptr;
+    std::vector<uint8_t> buf;
+    std::vector<int> anterior;
+    std::vector<uint8_t> textos_pendentes;   // já codificados: tamanho + texto
+    uint32_t num_textos_pendentes = 0;
+    int ultimo_ciclo = 0;
+
+    static void varint_em(std::vector<uint8_t>& destino, uint32_t v) {
+        while(v >= 0x80) {
+            destino.push_back((uint8_t)(v | 0x80));
+            v >>= 7;
+        }
+        destino.push_back((uint8_t)v);
+    }
+
+    void varint(uint32_t v) {
+        varint_em(buf, v);
+        if(buf.size() >= (1 << 16)) descarregar();
+    }
+
+    void zigzag(int v) {
+        varint(((uint32_t)v << 1) ^ (uint32_t)(v >> 31));
+    }
+
+    void descarregar() {
+        if(f && !buf.empty()) fwrite(buf.data(), 1, buf.size(), f);
+        buf.clear();
+    }
+
+public:
+    ~GravadorTrace() { fechar(); }
+
+    bool abrir(const std::string& nome, const std::vector<int>& parametros, size_t tamanho_estado) {
+        f = fopen(nome.c_str(), "wb");
+        if(!f) return false;
+        buf.reserve(1 << 16);
+        textos_pendentes.reserve(1 << 16);
+        buf.insert(buf.end(), {'T', 'O', 'M', 'T', VERSAO_TRACE});
+        varint(parametros.size());
+        for(int p : parametros) varint(p);
+        anterior.assign(tamanho_estado, 0);
+        ultimo_ciclo = 0;
+        return true;
+    }
+
+    // Texto de uma instrução lida, gravado com o próximo registro
+    void adicionar_texto(const char* texto) {
+        size_t n = strlen(texto);
+        varint_em(textos_pendentes, n);
+        textos_pendentes.insert(textos_pendentes.end(), texto, texto + n);
+        num_textos_pendentes++;
+    }
+
+    void registrar(int ciclo, const std::vector<int>& estado, const std::vector<std::pair<uint32_t, int>>& escritas) {
+        int alterados = 0;
+        for(size_t i = 0; i < estado.size(); i++) {
+            if(estado[i] != anterior[i]) alterados++;
+        }
+        
+        varint(ciclo - ultimo_ciclo);
+        varint(num_textos_pendentes);
+        if(num_textos_pendentes > 0) {
+            descarregar();
+            if(f) fwrite(textos_pendentes.data(), 1, textos_pendentes.size(), f);
+            textos_pendentes.clear();
+            num_textos_pendentes = 0;
+        }
+        varint(escritas.size());
+        for(const auto& [endereco, valor] : escritas) {
+            varint(endereco);
+            zigzag(valor);
+        }
+        varint(alterados);
+        size_t ultimo_indice = 0;
+        for(size_t i = 0; i < estado.size(); i++) {
+            if(estado[i] != anterior[i]) {
+                varint(i - ultimo_indice);
+                zigzag(estado[i]);
+                ultimo_indice = i;
+                anterior[i] = estado[i];
+            }
+        }
+        ultimo_ciclo = ciclo;
+    }
+
+    void finalizar(int total_ciclos) {
+        varint(0);
+        varint(total_ciclos);
+        fechar();
+    }
+
+    void fechar() {
+        descarregar();
+        if(f) fclose(f);
+        f = nullptr;
+    }
+};
+
+class LeitorTrace {
+private:
+    std::vector<uint8_t> dados;
+    size_t pos = 0;
+    int ciclo_atual = 0;
+
+public:
+    std::vector<int> parametros;
+    std::vector<std::string> textos;
+    std::vector<int> estado;
+    std::vector<std::pair<uint32_t, int>> escritas;   // escritas na memória do último registro
+    int total_ciclos = 0;
+
+    bool abrir(const std::string& nome) {
+        std::ifstream f(nome, std::ios::binary);
+        if(!f) return false;
+        dados.assign(std::istreambuf_iterator<char>(f), std::istreambuf_iterator<char>());
+        if(dados.size() < 5 || memcmp(dados.data(), "TOMT", 4) != 0 ||
+           dados[4] != VERSAO_TRACE) return false;
+        pos = 5;
+        
+        parametros.resize(varint());
+        for(int& p : parametros) p = varint();
+        return true;
+    }
+
+    uint32_t varint() {
+        uint32_t v = 0;
+        for(int desloc = 0; pos < dados.size(); desloc += 7) {
+            uint8_t b = dados[pos++];
+            v |= (uint32_t)(b & 0x7f) << desloc;
+            if(!(b & 0x80)) break;
+        }
+        return v;
+    }
+
+    // Aplica o próximo registro a 'estado'; retorna o ciclo, ou 0 no fim
+    int proximo() {
+        uint32_t delta = varint();
+        if(delta == 0) {
+            total_ciclos = varint();
+            return 0;
+        }
+        ciclo_atual += delta;
+        
+        uint32_t novos = varint();
+        for(uint32_t i = 0; i < novos; i++) {
+            size_t n = std::min<size_t>(varint(), dados.size() - pos);
+            textos.emplace_back((const char*)&dados[pos], n);
+            pos += n;
+        }
+        
+        escritas.resize(varint());
+        for(auto& [endereco, valor] : escritas) {
+            endereco = varint();
+            uint32_t z = varint();
+            valor = (int)(z >> 1) ^ -(int)(z & 1);
+        }
+        
+        uint32_t alterados = varint();
+        size_t indice = 0;
+        for(uint32_t i = 0; i < alterados; i++) {
+            indice += varint();
+            uint32_t z = varint();
+            if(indice < estado.size()) estado[indice] = (int)(z >> 1) ^ -(int)(z & 1);
+        }
+        return ciclo_atual;
+    }
+};
+
+/* Linha do tempo por instrução: para cada instrução dinâmica, os ciclos de
+   emissão, início da execução, fim (resultado no CDB ou desvio resolvido) e
+   consolidação (ou descarte), com a estação/buffer e a entrada do ROB
+   usadas. Dois formatos:
+     - Konata (.log e outros): eventos em ordem de ciclo, à medida que
+       acontecem (estágios Is = esperando na estação, Ex, Wb = pronta no ROB)
+     - Chrome trace-event (.json): um evento "X" por instrução no ROB e outro
+       na unidade onde executou, gravados ao sair do ROB
+   O registro de cada instrução em voo fica numa tabela indexada pela tag do
+   ROB e a saída passa por um buffer de tamanho fixo; nada é alocado
+   durante a simulação. */
+enum class Unidade : uint8_t { NENHUMA, RS_SOMA, RS_MUL, CARGA, ARM };
+
+const char* const NOMES_UNIDADE[] = { "ROB", "RS soma", "RS mul", "Buf. carga", "Buf. arm." };
+
+class GravadorLinhaTempo {
+private:
+    struct Registro {
+        long long seq = -1;     // -1 = entrada sem instrução registrada
+        int pc = 0;
+        int emissao = 0, inicio = 0, fim = 0;
+        Unidade unidade = Unidade::NENHUMA;
+        int slot = 0;
+        int thread = 0;
+        char texto[48] = "";
+    };
+
+    FILE* f = nullptr;
+    bool chrome = false;
+    bool smt = false;           // Chrome: anota a thread de cada instrução
+    std::vector<char> buf;
+    size_t usado = 0;
+    std::vector<Registro> em_voo;
+    long long proxima_seq = 0;
+    long long retiradas = 0;
+    int ciclo_escrito = -1;     // Konata: ciclo do último comando C
+    bool primeiro_evento = true;
+
+    void descarregar() {
+        if(f && usado > 0) fwrite(buf.data(), 1, usado, f);
+        usado = 0;
+    }
+
+    // Formata no buffer, esvaziando-o antes se estiver perto do fim (cada
+    // chamada escreve bem menos de 512 bytes)
+    template<class... Args>
+    void escrever(const char* fmt, Args... args) {
+        if(buf.size() - usado < 512) descarregar();
+        int n = snprintf(buf.data() + usado, buf.size() - usado, fmt, args...);
+        if(n > 0) usado += std::min((size_t)n, buf.size() - usado - 1);
+    }
+
+    // Konata: avança o ciclo corrente até 'ciclo'
+    void ciclo_konata(int ciclo) {
+        if(ciclo_escrito < 0) escrever("Kanata\t0004\nC=\t%d\n", ciclo);
+        else if(ciclo > ciclo_escrito) escrever("C\t%d\n", ciclo - ciclo_escrito);
+        ciclo_escrito = ciclo;
+    }
+
+    void unidade_texto(const Registro& r, char* destino, size_t n) const {
+        if(r.unidade == Unidade::NENHUMA) snprintf(destino, n, "-");
+        else snprintf(destino, n, "%s %d", NOMES_UNIDADE[(int)r.unidade], r.slot);
+    }
+
+    // Chrome: eventos da instrução que saiu do ROB no ciclo 'saida'
+    void gravar_chrome(int tag, const Registro& r, int saida, bool descartada) {
+        char unidade[32];
+        unidade_texto(r, unidade, sizeof(unidade));
+        char thread[24] = "";
+        if(smt) snprintf(thread, sizeof(thread), ",\"thread\":%d", r.thread);
+        escrever("%s{\"name\":\"%s\",\"cat\":\"%s\",\"ph\":\"X\",\"ts\":%d,\"dur\":%d,\"pid\":0,\"tid\":%d,"
+                 "\"args\":{\"seq\":%lld,\"pc\":%d,\"unidade\":\"%s\",\"emissao\":%d,\"inicio\":%d,\"fim\":%d,\"%s\":%d%s}}",
+                 primeiro_evento ? "" : ",\n", r.texto, descartada ? "descartada" : "consolidada",
+                 r.emissao, saida - r.emissao + 1, tag, r.seq, r.pc, unidade,
+                 r.emissao, r.inicio, r.fim, descartada ? "descarte" : "consolidacao", saida, thread);
+        primeiro_evento = false;
+        if(r.unidade != Unidade::NENHUMA && r.inicio > 0) {
+            int fim = r.fim > 0 ? r.fim : saida;
+            escrever(",\n{\"name\":\"%s\",\"cat\":\"execucao\",\"ph\":\"X\",\"ts\":%d,\"dur\":%d,\"pid\":%d,\"tid\":%d,"
+                     "\"args\":{\"seq\":%lld}}",
+                     r.texto, r.inicio, fim - r.inicio + 1, (int)r.unidade, r.slot, r.seq);
+        }
+    }
+
+    void sair(int ciclo, int tag, bool descartada) {
+        Registro& r = em_voo[tag];
+        if(r.seq < 0) return;
+        if(chrome) gravar_chrome(tag, r, ciclo, descartada);
+        else {
+            ciclo_konata(ciclo);
+            escrever("R\t%lld\t%lld\t%d\n", r.seq, descartada ? r.seq : retiradas, descartada ? 1 : 0);
+        }
+        if(!descartada) retiradas++;
+        r.seq = -1;
+    }
+
+public:
+    ~GravadorLinhaTempo() { fechar(); }
+
+    // O formato sai da extensão: .json = Chrome, senão Konata
+    bool abrir(const std::string& nome, int tam_rob, int threads = 1) {
+        f = fopen(nome.c_str(), "w");
+        if(!f) return false;
+        chrome = nome.size() >= 5 && nome.compare(nome.size() - 5, 5, ".json") == 0;
+        smt = threads > 1;
+        buf.assign(1 << 16, 0);
+        em_voo.assign(tam_rob + 1, Registro());
+        if(chrome) {
+            escrever("{\"displayTimeUnit\":\"ns\",\"otherData\":{\"unidade_de_tempo\":\"ciclo\"},\"traceEvents\":[\n");
+            for(int u = 0; u <= (int)Unidade::ARM; u++) {
+                escrever("{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":%d,\"args\":{\"name\":\"%s\"}},\n",
+                         u, NOMES_UNIDADE[u]);
+            }
+        }
+        return true;
+    }
+
+    // 'thread' é a thread SMT da instrução (Konata: campo TID do comando I)
+    void emitida(int ciclo, int tag, int pc, const char* texto, Unidade unidade, int slot, int thread) {
+        Registro& r = em_voo[tag];
+        r.seq = proxima_seq++;
+        r.pc = pc;
+        r.thread = thread;
+        r.emissao = ciclo;
+        r.inicio = r.fim = 0;
+        r.unidade = unidade;
+        r.slot = slot;
+        // Aspas e barras trocadas para não precisar escapar no JSON
+        size_t i = 0;
+        for(; texto[i] && i + 1 < sizeof(r.texto); i++) {
+            r.texto[i] = texto[i] == '"' || texto[i] == '\\' ? '\'' : texto[i];
+        }
+        r.texto[i] = '\0';
+        if(!chrome) {
+            ciclo_konata(ciclo);
+            char detalhe[32];
+            unidade_texto(r, detalhe, sizeof(detalhe));
+            escrever("I\t%lld\t%lld\t%d\nL\t%lld\t0\t%d: %s\nL\t%lld\t1\tROB %d, %s\nS\t%lld\t0\tIs\n",
+                     r.seq, r.seq, thread, r.seq, pc, r.texto, r.seq, tag, detalhe, r.seq);
+        }
+    }
+
+    void iniciou(int ciclo, int tag) {
+        Registro& r = em_voo[tag];
+        if(r.seq < 0) return;
+        r.inicio = ciclo;
+        if(!chrome) {
+            ciclo_konata(ciclo);
+            escrever("S\t%lld\t0\tEx\n", r.seq);
+        }
+    }
+
+    void terminou(int ciclo, int tag) {
+        Registro& r = em_voo[tag];
+        if(r.seq < 0) return;
+        r.fim = ciclo;
+        if(!chrome) {
+            ciclo_konata(ciclo);
+            escrever("S\t%lld\t0\tWb\n", r.seq);
+        }
+    }
+
+    void consolidada(int ciclo, int tag) { sair(ciclo, tag, false); }
+    void descartada(int ciclo, int tag) { sair(ciclo, tag, true); }
+
+    void finalizar() {
+        if(chrome) escrever("\n]}\n");
+        fechar();
+    }
+
+    void fechar() {
+        descarregar();
+        if(f) fclose(f);
+        f = nullptr;
+    }
+};
+
+/* Checkpoint do simulador.
+   Formato: "TOMC" | versão (1 byte) | parâmetros da máquina (na ordem de
+   PARAMETROS_MAQUINA) | hash do programa | ciclo | palavras da imagem de
+   memória | campos de SimuladorTomasulo::visitar_checkpoint() | nº de páginas
+   de memória alocadas | para cada uma: número da página + palavras. Inteiros vão em varint LEB128 de
+   64 bits, com zigzag; doubles, nos 8 bytes do IEEE 754, para que as
+   estatísticas retomadas sejam idênticas às da execução sem interrupção. */
+constexpr uint8_t VERSAO_CHECKPOINT = 5;
+
+class FluxoCheckpoint {
+private:
+    std::vector<uint8_t> dados;
+    size_t pos = 0;
+    bool falhou = false;
+
+    void varint(uint64_t v) {
+        while(v >= 0x80) {
+            dados.push_back((uint8_t)(v | 0x80));
+            v >>= 7;
+        }
+        dados.push_back((uint8_t)v);
+    }
+
+    uint64_t ler_varint() {
+        uint64_t v = 0;
+        for(int desloc = 0; ; desloc += 7) {
+            if(pos >= dados.size() || desloc > 63) {
+                falhou = true;
+                return 0;
+            }
+            uint8_t b = dados[pos++];
+            v |= (uint64_t)(b & 0x7f) << desloc;
+            if(!(b & 0x80)) return v;
+        }
+    }
+
+public:
+    template<class T>
+    void gravar(const T& v) {
+        if constexpr(std::is_floating_point_v<T>) {
+            uint8_t b[sizeof(double)];
+            double d = v;
+            memcpy(b, &d, sizeof(d));
+            dados.insert(dados.end(), b, b + sizeof(d));
+        } else if constexpr(std::is_enum_v<T>) {
+            varint((uint64_t)v);
+        } else {
+            int64_t x = (int64_t)v;
+            varint(((uint64_t)x << 1) ^ (uint64_t)(x >> 63));
+        }
+    }
+
+    template<class T>
+    void ler(T& v) {
+        if constexpr(std::is_floating_point_v<T>) {
+            double d = 0;
+            if(pos + sizeof(d) > dados.size()) falhou = true;
+            else memcpy(&d, &dados[pos], sizeof(d));
+            pos += sizeof(d);
+            v = (T)d;
+        } else if constexpr(std::is_enum_v<T>) {
+            v = (T)ler_varint();
+        } else {
+            uint64_t z = ler_varint();
+            v = (T)(int64_t)((z >> 1) ^ (~(z & 1) + 1));
+        }
+    }
+
+    bool ok() const { return !falhou; }
+    bool no_fim() const { return pos == dados.size(); }
+
+    bool gravar_arquivo(const std::string& nome) const {
+        FILE* f = fopen(nome.c_str(), "wb");
+        if(!f) return false;
+        bool ok = fwrite("TOMC", 1, 4, f) == 4 && fputc(VERSAO_CHECKPOINT, f) != EOF &&
+                  fwrite(dados.data(), 1, dados.size(), f) == dados.size();
+        return fclose(f) == 0 && ok;
+    }
+
+    bool ler_arquivo(const std::string& nome) {
+        std::ifstream f(nome, std::ios::binary);
+        if(!f) return false;
+        dados.assign(std::istreambuf_iterator<char>(f), std::istreambuf_iterator<char>());
+        if(dados.size() < 5 || memcmp(dados.data(), "TOMC", 4) != 0 ||
+           dados[4] != VERSAO_CHECKPOINT) return false;
+        pos = 5;
+        return true;
+    }
+};
+
+// Grava / lê a configuração da máquina no início de um checkpoint
+inline void gravar_config(FluxoCheckpoint& fluxo, const ConfigMaquina& cfg) {
+    for(const auto& p : PARAMETROS_MAQUINA) fluxo.gravar(cfg.*(p.campo));
+}
+
+inline bool ler_config(FluxoCheckpoint& fluxo, ConfigMaquina& cfg) {
+    for(const auto& p : PARAMETROS_MAQUINA) {
+        int v = 0;
+        fluxo.ler(v);
+        if(v < p.minimo || v > p.maximo) return false;
+        cfg.*(p.campo) = v;
+    }
+    return fluxo.ok();
+}
+
+// Lê só a configuração da máquina gravada num checkpoint, para criar o
+// simulador que vai restaurá-lo
+inline bool config_checkpoint(const std::string& arquivo, ConfigMaquina& cfg) {
+    FluxoCheckpoint fluxo;
+    return fluxo.ler_arquivo(arquivo) && ler_config(fluxo, cfg);
+}
+
+// Motivo pelo qual a emissão parou em um ciclo
+enum class Parada { NENHUMA, FIM_PROGRAMA, ROB_CHEIO, RS_SOMA_CHEIA, RS_MUL_CHEIA,
+                    BUFFER_CARGA_CHEIO, BUFFER_ARM_CHEIO, REGS_FISICOS_ESGOTADOS, NUM_PARADAS };
+
+const char* const NOMES_PARADA[] = { "nenhuma", "fim_programa", "rob_cheio", "rs_soma_cheia",
+                                     "rs_mul_cheia", "buffer_carga_cheio", "buffer_arm_cheio",
+                                     "regs_fisicos_esgotados" };
+
+constexpr int NUM_TIPOS_OP = (int)TipoOp::NOP + 1;
+
+// Contadores por banco de unidades, somados a cada ciclo
+struct ContadoresUnidade {
+    long long ocupacao = 0;          // entradas ocupadas
+    long long executando = 0;        // entradas em execução
+    long long espera_operandos = 0;  // entradas paradas esperando Qj/Qk (ou Q)
+};
+
+// Contadores de um nível de cache
+struct ContadoresCache {
+    long long acessos = 0;
+    long long faltas = 0;
+    long long pendentes = 0;        // acertos numa linha que ainda está chegando
+    long long escritas_volta = 0;   // linhas sujas tiradas (para o nível de baixo)
+};
+
+/* Um nível de cache de dados: 'conjuntos' conjuntos de 'assoc' vias, com
+   write-back, alocação na escrita e substituição LRU. Só guarda as tags, em
+   arranjos paralelos por via (os dados continuam na MemoriaPaginada);
+   'pronta' é o ciclo em que a linha chega, para acessos que a encontram
+   ainda a caminho. 'assinatura' resume o conteúdo (tags, sujas e a ordem
+   LRU de cada conjunto) para a detecção de regime dos laços; é mantida a
+   cada acesso, refazendo só o conjunto tocado. */
+struct NivelCache {
+    int conjuntos = 0, assoc = 0;
+    std::vector<uint32_t> linha;         // número da linha (endereço >> bits da linha)
+    std::vector<uint8_t> valida, suja;
+    std::vector<long long> uso;          // último acesso, para o LRU
+    std::vector<int> pronta;
+    long long relogio = 0;
+    std::vector<uint64_t> hash_conjunto;
+    uint64_t assinatura = 0;        // xor de hash_conjunto
+
+    void configurar(int tamanho, int assoc, int palavras_linha) {
+        this->assoc = assoc;
+        conjuntos = tamanho / (palavras_linha * assoc);
+        size_t n = (size_t)conjuntos * assoc;
+        linha.assign(n, 0);
+        valida.assign(n, 0);
+        suja.assign(n, 0);
+        uso.assign(n, 0);
+        pronta.assign(n, 0);
+        relogio = 0;
+        hash_conjunto.assign(conjuntos, 0);
+        assinatura = 0;
+    }
+
+    bool ativo() const { return conjuntos > 0; }
+
+    // Refaz o hash do conjunto c: cada via válida com a tag, se está suja e
+    // a posição na ordem LRU (o relógio absoluto fica de fora)
+    void assinar(int c) {
+        int base = c * assoc;
+        uint64_t h = 0;
+        for(int v = base; v < base + assoc; v++) {
+            if(!valida[v]) continue;
+            int ordem = 0;
+            for(int w = base; w < base + assoc; w++) ordem += valida[w] && uso[w] > uso[v];
+            uint64_t g = 0xcbf29ce484222325ULL;
+            for(long long x : { (long long)c, (long long)(v - base), (long long)linha[v],
+                                (long long)suja[v], (long long)ordem }) {
+                g = (g ^ (uint64_t)x) * 0x100000001b3ULL;
+            }
+            h += g;
+        }
+        assinatura ^= hash_conjunto[c] ^ h;
+        hash_conjunto[c] = h;
+    }
+
+    // Depois de restaurar um checkpoint (o hash não é gravado)
+    void assinar_tudo() {
+        for(int c = 0; c < conjuntos; c++) assinar(c);
+    }
+
+    // Via que guarda a linha l (e a marca como usada e, numa escrita, suja),
+    // ou -1
+    int buscar(uint32_t l, bool escrita = false) {
+        int c = (int)(l % conjuntos), base = c * assoc;
+        for(int v = base; v < base + assoc; v++) {
+            if(valida[v] && linha[v] == l) {
+                uso[v] = ++relogio;
+                suja[v] |= escrita;
+                assinar(c);
+                return v;
+            }
+        }
+        return -1;
+    }
+
+    // Põe a linha l no lugar da via menos usada do conjunto. Se a via tirada
+    // estava suja, devolve true com o número dela em 'tirada'.
+    bool instalar(uint32_t l, bool escrita, int pronta_em, uint32_t& tirada) {
+        int c = (int)(l % conjuntos), base = c * assoc, v = base;
+        for(int w = base + 1; w < base + assoc; w++) {
+            if(!valida[w] || (valida[v] && uso[w] < uso[v])) v = w;
+        }
+        bool volta = valida[v] && suja[v];
+        tirada = linha[v];
+        linha[v] = l;
+        valida[v] = 1;
+        suja[v] = escrita;
+        uso[v] = ++relogio;
+        pronta[v] = pronta_em;
+        assinar(c);
+        return volta;
+    }
+};
+
+/* L1 e L2 (opcional) de dados de um núcleo. A linha entra nos dois níveis
+   já na falta, com o ciclo em que chega; quem a acessa antes espera por ela
+   sem ocupar outro MSHR. Cada falta da L1 ocupa um MSHR até a linha chegar.
+   As escritas de volta não custam ciclos (buffer de escrita). */
+struct HierarquiaCache {
+    NivelCache l1, l2;
+    int bits_linha = 0;
+    int lat_l1 = 0, lat_l2 = 0, lat_memoria = 0;
+    std::vector<int> fim_mshr;         // ciclo em que cada MSHR fica livre; vazio = sem limite
+    int ultima_chegada = 0;            // maior 'pronta' instalada (faltas sem limite de MSHRs)
+
+    void configurar(const ConfigMaquina& cfg) {
+        l1 = NivelCache();
+        l2 = NivelCache();
+        fim_mshr.clear();
+        ultima_chegada = 0;
+        if(cfg.l1_tamanho == 0) return;
+        while((1 << bits_linha) < cfg.linha_cache) bits_linha++;
+        l1.configurar(cfg.l1_tamanho, cfg.l1_assoc, cfg.linha_cache);
+        if(cfg.l2_tamanho > 0) l2.configurar(cfg.l2_tamanho, cfg.l2_assoc, cfg.linha_cache);
+        lat_l1 = cfg.l1_lat;
+        lat_l2 = cfg.l2_lat;
+        lat_memoria = cfg.lat_memoria;
+        fim_mshr.assign(cfg.mshrs, 0);
+    }
+
+    bool ativa() const { return l1.ativo(); }
+
+    // O endereço está na L1 (sem mexer no LRU)?
+    bool presente(uint32_t endereco) const {
+        uint32_t l = endereco >> bits_linha;
+        int base = (int)(l % l1.conjuntos) * l1.assoc;
+        for(int v = base; v < base + l1.assoc; v++) {
+            if(l1.valida[v] && l1.linha[v] == l) return true;
+        }
+        return false;
+    }
+
+    /* Acesso iniciado no ciclo 'ciclo': devolve a latência, ou -1 se é uma
+       falta e não há MSHR livre (o acesso tenta de novo no ciclo seguinte,
+       sem mudar nada). Com reservar = false (aquecimento no modo funcional)
+       não usa MSHR e a linha fica pronta em 'ciclo'. */
+    int acessar(uint32_t endereco, bool escrita, int ciclo, ContadoresCache& c1, ContadoresCache& c2,
+                bool reservar = true) {
+        uint32_t l = endereco >> bits_linha;
+        int v = l1.buscar(l, escrita);
+        if(v >= 0) {
+            c1.acessos++;
+            int espera = l1.pronta[v] - ciclo;
+            if(espera > lat_l1) {
+                c1.pendentes++;
+                return espera;
+            }
+            return lat_l1;
+        }
+        int mshr = -1;
+        if(reservar && !fim_mshr.empty()) {
+            for(int m = 0; m < (int)fim_mshr.size() && mshr < 0; m++) {
+                if(fim_mshr[m] <= ciclo) mshr = m;
+            }
+            if(mshr < 0) return -1;
+        }
+        c1.acessos++;
+        c1.faltas++;
+        int latencia = lat_l1;
+        if(l2.ativo()) {
+            c2.acessos++;
+            int v2 = l2.buscar(l);
+            if(v2 >= 0) {
+                latencia += lat_l2;
+                if(l2.pronta[v2] - ciclo > latencia) {
+                    c2.pendentes++;
+                    latencia = l2.pronta[v2] - ciclo;
+                }
+            } else {
+                c2.faltas++;
+                latencia += lat_l2 + lat_memoria;
+                uint32_t tirada;
+                if(l2.instalar(l, false, reservar ? ciclo + latencia : ciclo, tirada)) c2.escritas_volta++;
+            }
+        } else {
+            latencia += lat_memoria;
+        }
+        uint32_t tirada;
+        if(l1.instalar(l, escrita, reservar ? ciclo + latencia : ciclo, tirada)) {
+            c1.escritas_volta++;
+            escrever_volta_l2(tirada, c2);
+        }
+        if(mshr >= 0) fim_mshr[mshr] = ciclo + latencia;
+        if(reservar) ultima_chegada = std::max(ultima_chegada, ciclo + latencia);
+        return latencia;
+    }
+
+    // Pipeline vazio: nenhuma linha a caminho nem MSHR ocupado
+    void concluir_faltas() {
+        for(NivelCache* n : { &l1, &l2 }) n->pronta.assign(n->pronta.size(), 0);
+        fim_mshr.assign(fim_mshr.size(), 0);
+        ultima_chegada = 0;
+    }
+
+    // Estado restaurado de um checkpoint: refaz o que não é gravado
+    void restaurado() {
+        l1.assinar_tudo();
+        l2.assinar_tudo();
+        ultima_chegada = 0;
+        for(NivelCache* n : { &l1, &l2 }) {
+            for(int p : n->pronta) ultima_chegada = std::max(ultima_chegada, p);
+        }
+    }
+
+    // Linha suja tirada da L1: fica suja na L2 (que a aloca, se preciso)
+    void escrever_volta_l2(uint32_t l, ContadoresCache& c2) {
+        if(!l2.ativo()) return;
+        uint32_t tirada;
+        if(l2.buscar(l, true) < 0 && l2.instalar(l, true, 0, tirada)) c2.escritas_volta++;
+    }
+
+    // Estado para o checkpoint (os tamanhos vêm da configuração)
+    template<class Self, class F>
+    static void visitar(Self& s, F&& f) {
+        auto nivel = [&](auto& n) {
+            for(auto& x : n.linha) f(x);
+            for(auto& x : n.valida) f(x);
+            for(auto& x : n.suja) f(x);
+            for(auto& x : n.uso) f(x);
+            for(auto& x : n.pronta) f(x);
+            f(n.relogio);
+        };
+        nivel(s.l1);
+        nivel(s.l2);
+        for(auto& x : s.fim_mshr) f(x);
+    }
+};
+
+// Estatísticas acumuladas durante uma execução
+struct Estatisticas {
+    long long ciclos = 0;
+    long long emitidas = 0;
+    long long consolidadas = 0;
+    // [k] = número de ciclos em que k instruções foram emitidas / consolidadas
+    std::vector<long long> emissao_por_ciclo;
+    std::vector<long long> commit_por_ciclo;
+    
+    // Ciclos em que a emissão parou antes da largura máxima, por motivo
+    std::array<long long, (int)Parada::NUM_PARADAS> paradas_emissao{};
+    ContadoresUnidade rs_soma, rs_mul, buffer_carga, buffer_arm;
+    long long ocupacao_rob = 0;
+    long long fisicos_livres = 0;    // registradores físicos na lista livre, por ciclo
+    // Estações prontas que ficaram sem unidade funcional livre e resultados
+    // que perderam a disputa pelo CDB (somados a cada ciclo), e o total de
+    // resultados transmitidos
+    long long espera_uf_soma = 0;
+    long long espera_uf_mul = 0;
+    long long espera_cdb = 0;
+    long long transmissoes_cdb = 0;
+    // Caches de dados, e acessos prontos que esperaram um MSHR (por ciclo)
+    ContadoresCache cache_l1, cache_l2;
+    long long espera_mshr = 0;
+    // Ciclos sem commit com a cabeça do ROB ocupada e não pronta, por tipo de op
+    std::array<long long, NUM_TIPOS_OP> cabeca_bloqueada{};
+    
+    /* Pilha de CPI, em ciclos: a cada ciclo, a fração k/LARGURA_COMMIT vai
+       para 'base' e o resto para o motivo de não consolidar mais, isto é,
+       o tipo da instrução que ficou na cabeça do ROB, ou 'rob_vazio'.
+       Dividida pelo nº de instruções, a soma das parcelas é o CPI. */
+    double cpi_base = 0;
+    std::array<double, NUM_TIPOS_OP> cpi_cabeca{};
+    double cpi_rob_vazio = 0;
+    
+    // Desvios condicionais consolidados, previsões erradas entre eles e
+    // descartes do ROB (inclusive os causados por desvios que depois
+    // também foram descartados) com o total de instruções descartadas
+    long long desvios = 0;
+    long long desvios_mal_previstos = 0;
+    long long descartes = 0;
+    long long instrucoes_descartadas = 0;
+    
+    // Cargas da memória (LD com desl(Rb)) iniciadas, quantas receberam o
+    // valor de um ST em voo, quantas passaram à frente de um ST de endereço
+    // ainda desconhecido e quantas foram reexecutadas por conflito, com as
+    // instruções descartadas nessas reexecuções
+    long long cargas_memoria = 0;
+    long long cargas_encaminhadas = 0;
+    long long cargas_especulativas = 0;
+    long long reexecucoes = 0;
+    long long instrucoes_reexecutadas = 0;
+    
+    // Alocações no heap feitas durante o laço principal (deve ser 0)
+    size_t alocacoes_laco = 0;
+};
+
+// Chama f para cada contador de 'e' (menos ciclos e alocacoes_laco), numa
+// ordem fixa: a do checkpoint. Com mais estatísticas, f recebe o mesmo
+// campo de cada uma.
+template<class F, class E, class... Es>
+void visitar_estatisticas(F&& f, E& e, Es&... o) {
+    f(e.emitidas, o.emitidas...); f(e.consolidadas, o.consolidadas...);
+    for(size_t k = 0; k < e.emissao_por_ciclo.size(); k++) f(e.emissao_por_ciclo[k], o.emissao_por_ciclo[k]...);
+    for(size_t k = 0; k < e.commit_por_ciclo.size(); k++) f(e.commit_por_ciclo[k], o.commit_por_ciclo[k]...);
+    for(size_t k = 0; k < e.paradas_emissao.size(); k++) f(e.paradas_emissao[k], o.paradas_emissao[k]...);
+    for(auto u : { &Estatisticas::rs_soma, &Estatisticas::rs_mul, &Estatisticas::buffer_carga, &Estatisticas::buffer_arm }) {
+        f((e.*u).ocupacao, (o.*u).ocupacao...);
+        f((e.*u).executando, (o.*u).executando...);
+        f((e.*u).espera_operandos, (o.*u).espera_operandos...);
+    }
+    f(e.ocupacao_rob, o.ocupacao_rob...);
+    for(size_t k = 0; k < e.cabeca_bloqueada.size(); k++) f(e.cabeca_bloqueada[k], o.cabeca_bloqueada[k]...);
+    f(e.cpi_base, o.cpi_base...);
+    for(size_t k = 0; k < e.cpi_cabeca.size(); k++) f(e.cpi_cabeca[k], o.cpi_cabeca[k]...);
+    f(e.cpi_rob_vazio, o.cpi_rob_vazio...);
+    f(e.desvios, o.desvios...); f(e.desvios_mal_previstos, o.desvios_mal_previstos...);
+    f(e.descartes, o.descartes...); f(e.instrucoes_descartadas, o.instrucoes_descartadas...);
+    f(e.cargas_memoria, o.cargas_memoria...); f(e.cargas_encaminhadas, o.cargas_encaminhadas...);
+    f(e.cargas_especulativas, o.cargas_especulativas...);
+    f(e.reexecucoes, o.reexecucoes...); f(e.instrucoes_reexecutadas, o.instrucoes_reexecutadas...);
+    f(e.fisicos_livres, o.fisicos_livres...);
+    f(e.espera_uf_soma, o.espera_uf_soma...); f(e.espera_uf_mul, o.espera_uf_mul...);
+    f(e.espera_cdb, o.espera_cdb...); f(e.transmissoes_cdb, o.transmissoes_cdb...);
+    for(auto c : { &Estatisticas::cache_l1, &Estatisticas::cache_l2 }) {
+        f((e.*c).acessos, (o.*c).acessos...);
+        f((e.*c).faltas, (o.*c).faltas...);
+        f((e.*c).pendentes, (o.*c).pendentes...);
+        f((e.*c).escritas_volta, (o.*c).escritas_volta...);
+    }
+    f(e.espera_mshr, o.espera_mshr...);
+}
+
+// Tempo do hospedeiro gasto em cada estágio, somado em todos os ciclos (ns)
+struct TemposEstagio {
+    double emitir = 0;
+    double iniciar = 0;     // tentar_iniciar_* de todas as estações e buffers
+    double avancar = 0;     // avancar_execucao_e_escrever
+    double consolidar = 0;
+    long long ciclos = 0;   // ciclos medidos (os pulados no modo por eventos não contam)
+};
+
+// Opções de uma execução de SimuladorTomasulo::executar()
+struct OpcoesExecucao {
+    bool dirigido_eventos = false;
+    Verbosidade verbosidade = Verbosidade::COMPLETA;
+    GravadorTrace* trace = nullptr;
+    GravadorLinhaTempo* linha_tempo = nullptr;
+    TemposEstagio* tempos = nullptr;    // mede cada estágio (tem custo próprio)
+    // Grava um checkpoint no início deste ciclo (0 = nenhum)
+    int ciclo_checkpoint = 0;
+    std::string arquivo_checkpoint;
+    // Extrapola um laço depois de tantas repetições seguidas do seu regime
+    // permanente (0 = nunca; ver SimuladorTomasulo::verificar_fronteira)
+    int extrapolar_lacos = 0;
+};
+
+/* Execução controlada pelo chamador (passo(), continuar(), executar_ate()),
+   sem saída. Pontos de parada:
+   - PC: quando o PC de busca da thread passa a ser 'valor' (antes de emitir);
+   - CICLO: antes de simular o ciclo 'valor';
+   - COMMIT: depois do ciclo em que a instrução 'valor' da thread é consolidada;
+   - REGISTRADOR, MEMORIA (vigias): depois do ciclo em que muda o valor
+     consolidado do registrador 'valor' da thread, ou da palavra no endereço
+     'valor'.
+   thread < 0 vale para qualquer thread (nos vigias de registrador, a 0). */
+enum class TipoPontoParada : uint8_t { PC, CICLO, COMMIT, REGISTRADOR, MEMORIA };
+
+const char* const NOMES_PONTO_PARADA[] = { "pc", "ciclo", "commit", "registrador", "memoria" };
+
+struct PontoParada {
+    int id = 0;
+    TipoPontoParada tipo = TipoPontoParada::PC;
+    int valor = 0;
+    int thread = -1;
+    int anterior = 0;       // vigias: último valor visto
+};
+
+enum class MotivoParada : uint8_t { FIM, PASSOS, PONTO_PARADA, PREDICADO };
+
+const char* const NOMES_MOTIVO_PARADA[] = { "fim", "passos", "ponto_parada", "predicado" };
+
+struct ResultadoPasso {
+    MotivoParada motivo = MotivoParada::FIM;
+    int ciclo = 0;          // último ciclo simulado
+    int ponto = 0;          // id do ponto que disparou
+};
+
+// Estação de reserva ou buffer, para leitura sem formatação. Nos buffers,
+// Vj/Qj é o valor (lido ou a gravar), Vk/Qk o registrador base e 'endereco'
+// o deslocamento ou o imediato.
+struct VisaoEstacao {
+    bool ocupada = false;
+    bool executando = false;
+    TipoOp op = TipoOp::NOP;
+    int restante = 0;       // ciclos de execução restantes
+    int rob = 0;
+    int Vj = 0, Vk = 0, Qj = 0, Qk = 0;
+    int endereco = 0;
+};
+
+/* Simulação por amostragem. A cada 'intervalo' instruções, as primeiras
+   são só executadas funcionalmente (registradores, memória e preditor, sem
+   RS nem ROB); as últimas 'aquecimento' + 'janela' passam pelo modelo
+   detalhado: o aquecimento enche as estruturas e só a janela é medida.
+   Depois da janela a emissão para e o pipeline esvazia antes de voltar ao
+   modo funcional. O total de ciclos é estimado pelo CPI médio das janelas,
+   com intervalo de confiança de 95%. */
+struct ParametrosAmostragem {
+    long long intervalo = 100000;
+    long long janela = 2000;
+    long long aquecimento = 2000;
+};
+
+inline bool ler_parametros_amostragem(const std::string& texto, ParametrosAmostragem& a) {
+    std::stringstream ss(texto);
+    std::string item;
+    while(std::getline(ss, item, ',')) {
+        size_t igual = item.find('=');
+        if(igual == std::string::npos) return false;
+        std::string chave = item.substr(0, igual), valor = item.substr(igual + 1);
+        char* fim = nullptr;
+        long long v = strtoll(valor.c_str(), &fim, 10);
+        if(!fim || *fim) return false;
+        if(chave == "intervalo") a.intervalo = v;
+        else if(chave == "janela") a.janela = v;
+        else if(chave == "aquecimento") a.aquecimento = v;
+        else return false;
+    }
+    return a.janela >= 1 && a.aquecimento >= 0 && a.intervalo >= a.janela + a.aquecimento;
+}
+
+// Valor crítico bicaudal de 95% da distribuição t com 'gl' graus de liberdade
+inline double t_critico_95(long long gl) {
+    static const double T[] = { 12.706, 4.303, 3.182, 2.776, 2.571, 2.447, 2.365, 2.306, 2.262, 2.228,
+                                2.201, 2.179, 2.160, 2.145, 2.131, 2.120, 2.110, 2.101, 2.093, 2.086,
+                                2.080, 2.074, 2.069, 2.064, 2.060, 2.056, 2.052, 2.048, 2.045, 2.042 };
+    return gl >= 1 && gl <= 30 ? T[gl - 1] : 1.960;
+}
+
+struct ResultadoAmostragem {
+    bool ativa = false;
+    long long instrucoes_funcionais = 0;
+    long long instrucoes_detalhadas = 0;    // aquecimento, janelas e esvaziamento
+    std::vector<double> cpi;                // de cada janela medida
+    
+    long long instrucoes() const { return instrucoes_funcionais + instrucoes_detalhadas; }
+
+    double cpi_medio() const {
+        double soma = 0;
+        for(double c : cpi) soma += c;
+        return cpi.empty() ? 0.0 : soma / cpi.size();
+    }
+
+    // Meia largura do intervalo de confiança de 95% do CPI médio
+    double meia_largura() const {
+        if(cpi.size() < 2) return 0.0;
+        double m = cpi_medio(), q = 0;
+        for(double c : cpi) q += (c - m) * (c - m);
+        double desvio = sqrt(q / (cpi.size() - 1));
+        return t_critico_95((long long)cpi.size() - 1) * desvio / sqrt((double)cpi.size());
+    }
+};
+
+// Laços extrapolados por executar() com OpcoesExecucao::extrapolar_lacos
+struct ResultadoExtrapolacao {
+    bool ativa = false;
+    long long lacos = 0;                    // vezes que um laço foi extrapolado
+    double iteracoes = 0;
+    long long instrucoes = 0;               // com tempo extrapolado, não simulado
+    long long instrucoes_funcionais = 0;    // parte delas executada sem o pipeline
+    long long ciclos = 0;                   // atribuídos a essas instruções
+};
+
+// Fronteira de iteração de laço: commit de um desvio para trás tomado
+struct FronteiraLaco {
+    uint64_t assinatura = 0;    // ver SimuladorTomasulo::assinatura_temporal()
+    int ciclo = 0;
+    long long instrucoes = 0;   // consolidadas até o fim do ciclo
+    long long faltas_l1 = 0, faltas_l2 = 0;     // da cache, até o fim do ciclo
+};
+
+// Maior período de regime permanente, em iterações (há laços cujo tempo só
+// se repete a cada 2 ou mais iterações)
+constexpr int PERIODO_MAXIMO_LACO = 8;
+// Laços (desvios para trás) acompanhados ao mesmo tempo, como os de um
+// aninhamento
+constexpr int LACOS_MONITORADOS = 4;
+
+// Cada extrapolação erra em até uns poucos ciclos de esvaziamento, e o
+// número de iterações que ainda faltam só é conhecido depois dele. Por isso
+// o esvaziamento só começa quando o laço já está em regime há este múltiplo
+// do custo estimado para esvaziar: o erro fica abaixo de 1/GANHO_MINIMO_LACO
+// do tempo do laço, por poucas que sejam as iterações restantes. Um laço
+// executado de novo (interno a outro) só volta a ser extrapolado se da
+// última vez os ciclos extrapolados passaram do mesmo múltiplo dos de
+// esvaziamento; senão fica no modelo detalhado e o laço externo, com tempo
+// exato por iteração, é que pode ser extrapolado
+constexpr int GANHO_MINIMO_LACO = 100;
+
+// Últimas fronteiras de um laço e as estatísticas em cada uma
+struct LacoMonitorado {
+    int pc = -1, alvo = 0;      // desvio e início do corpo
+    bool curto = false;         // extrapolado com ganho < GANHO_MINIMO_LACO
+    int inicio_regime = 0;      // ciclo da última fronteira fora do regime
+    long long n = 0;            // fronteiras vistas
+    long long uso = 0;          // para substituir o menos recente
+    std::vector<FronteiraLaco> fronteiras;   // circular
+    std::array<Estatisticas, PERIODO_MAXIMO_LACO + 1> est;
+
+    FronteiraLaco& fronteira(long long k) { return fronteiras[k % fronteiras.size()]; }
+    Estatisticas& est_fronteira(long long k) { return est[k % est.size()]; }
+};
+
+// Detecção de regime permanente (ver SimuladorTomasulo::verificar_fronteira)
+struct DetectorLaco {
+    int exigidas = 0;               // períodos iguais para extrapolar (0 = desligado)
+    bool pendente = false;          // desvio para trás consolidado no ciclo corrente
+    int pc_pendente = 0, alvo_pendente = 0;
+    long long relogio = 0;
+    std::array<LacoMonitorado, LACOS_MONITORADOS> lacos;
+    LacoMonitorado* detectado = nullptr;    // esvaziando o pipeline para extrapolá-lo
+    int periodo = 0;                        // dele, em iterações
+    std::vector<int> posicao_fisico;     // banco físico: posição no ROB de quem produz cada um
+};
+
+// Estado próprio de cada thread de hardware: programa, PC, registradores e
+// preditor. Estações, buffers, unidades, ROB e memória são do núcleo.
+struct ContextoThread {
+    JanelaBusca janela;
+    int pc = 0;
+    // Total de instruções do programa, ou -1 enquanto a leitura em streaming
+    // não chegou ao fim do arquivo
+    int total_instr = -1;
+    BancoRegistradores arquivo_reg;
+    PreditorDesvios preditor;
+    int particao = 0;           // fila do ROB usada pela thread
+    long long emitidas = 0;
+    long long consolidadas = 0;
+    long long ciclo_fim = 0;    // ciclo do último commit
+};
+
+// Fila circular do ROB nas entradas [inicio, fim]; vazia se cabeca == cauda
+struct ParticaoROB {
+    int inicio = 1, fim = 1;
+    int cabeca = 1, cauda = 1;
+
+    int tamanho() const { return fim - inicio + 1; }
+    int usadas() const { return cauda >= cabeca ? cauda - cabeca : cauda - cabeca + tamanho(); }
+};
+
+template<class Forma>
+class SimuladorTomasulo {
+private:
+    // Threads de hardware: uma, ou várias com --smt
+    std::vector<ContextoThread> contextos;
+    const std::vector<std::string>* textos_restaurados = nullptr;   // só no decodificador
+    
+    // Estruturas do algoritmo de Tomasulo
+    ConfigMaquina cfg;
+    BancoRS<Forma::rs_soma_count> RS_soma;
+    BancoRS<Forma::rs_mul_count> RS_mul;
+    BancoBuffers<Forma::buffer_carga_count> BufferCarga;
+    BancoBuffers<Forma::buffer_arm_count> BufferArm;
+    Arranjo<EntradaROB, Forma::dinamica ? 0 : Forma::tam_rob + 1> ROB;
+    // Filas circulares do ROB: uma só, ou uma por thread no SMT particionado
+    std::vector<ParticaoROB> particoes;
+    // Banco de registradores físicos (REGS_FISICOS > 0), índices 1..N. A
+    // tabela de mapeamento de cada thread é arquivo_reg.tag (sempre != 0) e
+    // a lista livre é a pilha livres[0, n_livres)
+    std::vector<int> valor_fisico;
+    Mascara<0> pronto_fisico;
+    std::vector<int> livres;
+    int n_livres = 0;
+    HierarquiaCache cache;      // L1_TAMANHO > 0
+    // Acessos do modo funcional (fora das estatísticas) e, se >= 0, quantas
+    // faltas da L1 ele pode ter antes de parar (ver extrapolar_laco())
+    ContadoresCache funcional_l1, funcional_l2;
+    long long limite_faltas_funcional = -1;
+    
+    // Instruções emitidas / consolidadas no último ciclo simulado
+    int emitidas_ciclo = 0, consolidadas_ciclo = 0;
+    int ciclo_inicial = 1;      // > 1 quando retomado de um checkpoint
+    bool drenando = false;      // amostragem: fim da janela, só esvazia o pipeline
+    int ciclo_atual = 0;        // ciclo em simulação, para a linha do tempo
+    int rodizio = 0;            // SMT: thread com prioridade neste ciclo
+    std::array<int, MAX_THREADS_SMT> ordem_emissao{};
+    std::vector<double> ipc_isolado;     // SMT: IPC de cada programa sozinho no núcleo
+    GravadorLinhaTempo* linha_tempo = nullptr;
+    ResultadoAmostragem amostragem;
+    ResultadoExtrapolacao extrapolacao;
+    std::string erro_ckp;            // ver erro_checkpoint()
+    DetectorLaco laco;
+    Estatisticas est;
+    // Memória de dados: a própria ou, no multinúcleo, a compartilhada, com
+    // as escritas do quantum em escritas_pendentes
+    MemoriaPaginada memoria_propria;
+    MemoriaPaginada* memoria = &memoria_propria;
+    BufferEscritas* escritas_pendentes = nullptr;
+    int proximo_ciclo = 1;      // próximo ciclo de executar_quantum() e de passo()
+    // Pontos de parada e vigias de passo(); commit_disparado é o id do ponto
+    // de COMMIT atingido no ciclo corrente
+    std::vector<PontoParada> pontos;
+    int proximo_ponto = 1;
+    int commit_disparado = 0;
+    bool pular_ociosos = false;
+
+public:
+    explicit SimuladorTomasulo(const ConfigMaquina& config = ConfigMaquina()) : cfg(config) {
+        RS_soma.redimensionar(cfg.rs_soma_count);
+        RS_mul.redimensionar(cfg.rs_mul_count);
+        BufferCarga.redimensionar(cfg.buffer_carga_count);
+        BufferArm.redimensionar(cfg.buffer_arm_count);
+        ROB.assign(cfg.tam_rob + 1, EntradaROB());
+        contextos.reserve(MAX_THREADS_SMT);
+        contextos.emplace_back();
+        contextos[0].preditor.configurar(cfg.preditor, cfg.bits_preditor);
+        dividir_rob();
+        if(usa_fisicos()) iniciar_fisicos();
+        cache.configurar(cfg);
+        est.emissao_por_ciclo.assign(cfg.largura_emissao + 1, 0);
+        est.commit_por_ciclo.assign(cfg.largura_commit + 1, 0);
+    }
+
+    SimuladorTomasulo(const SimuladorTomasulo&) = delete;
+    SimuladorTomasulo& operator=(const SimuladorTomasulo&) = delete;
+
+    const Estatisticas& estatisticas() const { return est; }
+
+    const ConfigMaquina& config() const { return cfg; }
+
+    // Tamanhos da forma, constantes quando ela é fixa
+    int tam_rob() const { return Forma::dinamica ? cfg.tam_rob : Forma::tam_rob; }
+    int largura_emissao() const { return Forma::dinamica ? cfg.largura_emissao : Forma::largura_emissao; }
+    int largura_commit() const { return Forma::dinamica ? cfg.largura_commit : Forma::largura_commit; }
+    static const char* nome_forma() { return Forma::nome(); }
+
+    int num_threads() const { return (int)contextos.size(); }
+
+    void definir_programa(std::shared_ptr<const ImagemPrograma> prog) {
+        contextos[0].pc = 0;
+        contextos[0].total_instr = prog->tamanho();
+        contextos[0].janela.definir_programa(std::move(prog));
+    }
+
+
+    const char* texto_instr(int th, int idx) const {
+        if(!textos_restaurados) return contextos[th].janela.texto(idx);
+        return idx >= 0 && idx < (int)textos_restaurados->size() ? (*textos_restaurados)[idx].c_str() : "";
+    }
+
+    const char* nomeOp(TipoOp t) const {
+        return NOMES_OP[(int)t];
+    }
+
+    // Abre o programa (imagem binária, cache de imagens em 'dir_cache' ou
+    // leitura em streaming); erros de leitura (inclusive os encontrados mais
+    // tarde, durante a simulação) ficam em erro_programa()
+    bool carregarPrograma(const std::string& filename, const std::string& dir_cache = "") {
+        ContextoThread& c = contextos[0];
+        c.pc = 0;
+        bool ok = c.janela.abrir(filename, JANELA_ANTECIPACAO, dir_cache);
+        c.total_instr = c.janela.total();
+        return ok;
+    }
+
+    // SMT: mais uma thread de hardware, com o programa 'filename'. Com o ROB
+    // particionado, cada thread fica com uma parte igual das entradas.
+    bool adicionar_thread(const std::string& filename, const std::string& dir_cache = "") {
+        contextos.emplace_back();
+        ContextoThread& c = contextos.back();
+        c.preditor.configurar(cfg.preditor, cfg.bits_preditor);
+        bool ok = c.janela.abrir(filename, JANELA_ANTECIPACAO, dir_cache);
+        c.total_instr = c.janela.total();
+        dividir_rob();
+        if(usa_fisicos()) iniciar_fisicos();
+        return ok;
+    }
+
+    void dividir_rob() {
+        int n = cfg.rob_smt == ROB_SMT_COMPARTILHADO ? 1 : num_threads();
+        particoes.assign(n, ParticaoROB());
+        for(int p = 0, inicio = 1; p < n; p++) {
+            int tam = tam_rob() / n + (p < tam_rob() % n ? 1 : 0);
+            particoes[p].inicio = particoes[p].cabeca = particoes[p].cauda = inicio;
+            particoes[p].fim = inicio + tam - 1;
+            inicio += tam;
+        }
+        for(int th = 0; th < num_threads(); th++) contextos[th].particao = n == 1 ? 0 : th;
+    }
+
+    bool usa_fisicos() const { return cfg.regs_fisicos > 0; }
+
+    // Mapeia os registradores de cada thread em físicos prontos com o valor
+    // consolidado e põe o restante na lista livre (ver
+    // regs_fisicos_suficientes()). Só com o pipeline vazio.
+    void iniciar_fisicos() {
+        int n = cfg.regs_fisicos;
+        valor_fisico.assign(n + 1, 0);
+        pronto_fisico.redimensionar(n + 1);
+        livres.assign(n, 0);
+        int f = 1;
+        for(auto& c : contextos) {
+            for(int i = 0; i < REGISTRADORES; i++, f++) {
+                c.arquivo_reg.tag[i] = f;
+                valor_fisico[f] = c.arquivo_reg.consolidado[i];
+                pronto_fisico.ligar(f);
+            }
+        }
+        n_livres = 0;
+        for(int g = n; g >= f; g--) livres[n_livres++] = g;
+    }
+
+    const std::string& erro_programa() const {
+        for(const auto& c : contextos) {
+            if(!c.janela.erro().empty()) return c.janela.erro();
+        }
+        return contextos[0].janela.erro();
+    }
+
+    ParticaoROB& particao(int th) { return particoes[contextos[th].particao]; }
+    const ParticaoROB& particao(int th) const { return particoes[contextos[th].particao]; }
+
+    int slots_livres_rob(const ParticaoROB& p) const {
+        return p.tamanho() - p.usadas() - 1;
+    }
+
+    // Entradas ocupadas em todas as filas, e o máximo que cabe nelas
+    int ocupadas_rob() const {
+        int n = 0;
+        for(const auto& p : particoes) n += p.usadas();
+        return n;
+    }
+
+    int capacidade_rob() const { return tam_rob() - (int)particoes.size(); }
+
+    bool rob_vazio() const {
+        for(const auto& p : particoes) {
+            if(p.cabeca != p.cauda) return false;
+        }
+        return true;
+    }
+
+    // Cabeça usada nas estatísticas: a da primeira fila com instruções, ou 0
+    // (ROB[0] nunca é ocupada) se o ROB está vazio
+    int cabeca_principal() const {
+        for(const auto& p : particoes) {
+            if(p.cabeca != p.cauda) return p.cabeca;
+        }
+        return 0;
+    }
+
+    int alocar_rob(int th) {
+        ParticaoROB& p = particao(th);
+        int proximo = p.cauda;
+        ROB[proximo] = EntradaROB();
+        ROB[proximo].ocupada = true;
+        ROB[proximo].thread = th;
+        ROB[proximo].historico_antes = contextos[th].preditor.historico;
+        p.cauda = proxima_rob(p, p.cauda);
+        return proximo;
+    }
+
+    EntradaROB* entrada_rob(int tag) {
+        if(tag < 1 || tag > tam_rob()) return nullptr;
+        return &ROB[tag];
+    }
+
+    // Distância da entrada 'tag' até a cabeça da sua fila (0 = mais antiga)
+    static int posicao_rob(const ParticaoROB& p, int tag) {
+        int d = tag - p.cabeca;
+        return d < 0 ? d + p.tamanho() : d;
+    }
+
+    static int proxima_rob(const ParticaoROB& p, int tag) { return tag == p.fim ? p.inicio : tag + 1; }
+    static int anterior_rob(const ParticaoROB& p, int tag) { return tag == p.inicio ? p.fim : tag - 1; }
+
+    // Entrada ocupada por uma instrução da thread th (no ROB compartilhado,
+    // as filas misturam as threads)
+    bool da_thread(int tag, int th) const { return ROB[tag].ocupada && ROB[tag].thread == th; }
+
+    template<class Banco>
+    int encontrar_rs_livre(const Banco& rs) const {
+        return rs.livre();
+    }
+
+    int encontrar_buffer_carga_livre() const {
+        return BufferCarga.livre();
+    }
+
+    int encontrar_buffer_arm_livre() const {
+        return BufferArm.livre();
+    }
+
+    // Lê um operando do banco de registradores. Se o produtor já escreveu o
+    // resultado no ROB (mas ainda não consolidou), o valor vem direto do ROB,
+    // pois o CDB não vai transmiti-lo de novo. Com o banco físico, a tag é o
+    // registrador físico mapeado, e o valor vem dele quando pronto.
+    void ler_operando(const BancoRegistradores& regs, int reg, int& V, int& Q) {
+        int tag = regs.tag[reg];
+        if(usa_fisicos()) {
+            V = valor_fisico[tag];
+            Q = pronto_fisico.testar(tag) ? 0 : tag;
+        } else if(tag == 0) {
+            V = regs.valor[reg];
+            Q = 0;
+        } else if(ROB[tag].pronta) {
+            V = ROB[tag].valor;
+            Q = 0;
+        } else {
+            Q = tag;
+        }
+    }
+
+    // Verifica se a próxima instrução da thread th pode ser emitida; se não,
+    // diz por quê
+    Parada verificar_emissao(int th) {
+        if(drenando) return Parada::FIM_PROGRAMA;
+        ContextoThread& c = contextos[th];
+        const Instr* ins = c.janela.obter(c.pc);
+        if(!ins) return Parada::FIM_PROGRAMA;
+        if(slots_livres_rob(particao(th)) <= 0) return Parada::ROB_CHEIO;
+        if(n_livres == 0 && usa_fisicos() && escreve_registrador(ins->tipo)) return Parada::REGS_FISICOS_ESGOTADOS;
+        
+        switch(ins->tipo) {
+            case TipoOp::J:
+                return Parada::NENHUMA;     // só ocupa o ROB
+            case TipoOp::LD: 
+                return encontrar_buffer_carga_livre() >= 0 ? Parada::NENHUMA : Parada::BUFFER_CARGA_CHEIO;
+            case TipoOp::ST: 
+                return encontrar_buffer_arm_livre() >= 0 ? Parada::NENHUMA : Parada::BUFFER_ARM_CHEIO;
+            case TipoOp::MUL:
+            case TipoOp::DIV: 
+                return encontrar_rs_livre(RS_mul) >= 0 ? Parada::NENHUMA : Parada::RS_MUL_CHEIA;
+            default: 
+                return encontrar_rs_livre(RS_soma) >= 0 ? Parada::NENHUMA : Parada::RS_SOMA_CHEIA;
+        }
+    }
+
+    // Motivo contado quando nenhuma thread consegue emitir mais: com várias,
+    // o de maior número, para não depender da ordem de emissão (as paradas
+    // estruturais vêm antes do fim de programa)
+    Parada verificar_emissao() {
+        Parada parada = Parada::NENHUMA;
+        for(int th = 0; th < num_threads(); th++) parada = std::max(parada, verificar_emissao(th));
+        return parada;
+    }
+
+    // Verifica se emitir() conseguiria emitir alguma instrução neste ciclo
+    bool pode_emitir() {
+        for(int th = 0; th < num_threads(); th++) {
+            if(verificar_emissao(th) == Parada::NENHUMA) return true;
+        }
+        return false;
+    }
+
+    // Emite uma instrução aritmética da thread th na estação idx do banco de RS
+    template<class Banco>
+    void emitir_aritmetica(Banco& banco, int idx, const Instr& ins, Unidade unidade, int th) {
+        ContextoThread& c = contextos[th];
+        int tag = alocar_rob(th);
+        
+        banco.ocupada.ligar(idx);
+        banco.executando.desligar(idx);
+        banco.op[idx] = ins.tipo;
+        banco.indice_rob[idx] = tag;
+        banco.ciclosExecRestantes[idx] = 0;
+        
+        // Verifica dependências para src1 e src2
+        ler_operando(c.arquivo_reg, ins.src1, banco.Vj[idx], banco.Qj[idx]);
+        ler_operando(c.arquivo_reg, ins.src2, banco.Vk[idx], banco.Qk[idx]);
+        
+        EntradaROB* r = entrada_rob(tag);
+        r->ocupada = true;
+        r->op = ins.tipo;
+        r->dest = ins.dest;
+        r->pronta = false;
+        r->indice_instr = c.pc;
+        if(linha_tempo) linha_tempo->emitida(ciclo_atual, tag, c.pc, c.janela.texto(c.pc), unidade, idx, th);
+        
+        if(escreve_registrador(ins.tipo)) renomear_destino(c, *r, ins.dest, tag);
+        else r->dest = -1;
+        c.pc = eh_desvio(ins.tipo) ? prever_desvio(c, *r, ins) : c.pc + 1;
+    }
+
+    // Aponta o registrador dest para a entrada 'tag' do ROB ou, com o banco
+    // físico, para um registrador físico tirado da lista livre
+    void renomear_destino(ContextoThread& c, EntradaROB& r, int dest, int tag) {
+        if(usa_fisicos()) {
+            r.fisico_anterior = c.arquivo_reg.tag[dest];
+            r.fisico = livres[--n_livres];
+            pronto_fisico.desligar(r.fisico);
+            tag = r.fisico;
+        }
+        c.arquivo_reg.tag[dest] = tag;
+    }
+
+    // Prevê o desvio em c.pc e retorna o próximo pc (alvo ou pc + 1)
+    static int prever_desvio(ContextoThread& c, EntradaROB& r, const Instr& ins) {
+        r.historico_antes = c.preditor.historico;
+        r.indice_preditor = c.preditor.indice(c.pc);
+        r.previsto_tomado = c.preditor.prever(c.pc, ins.imm, r.indice_preditor);
+        c.preditor.registrar(r.historico_antes, r.previsto_tomado);
+        return r.previsto_tomado ? ins.imm : c.pc + 1;
+    }
+
+    // Emite a instrução em pc da thread th, se houver espaço no ROB e na
+    // estrutura de destino; senão retorna o motivo da espera (risco estrutural)
+    Parada emitir_uma(int th) {
+        Parada parada = verificar_emissao(th);
+        if(parada != Parada::NENHUMA) return parada;
+        
+        ContextoThread& c = contextos[th];
+        int& pc = c.pc;
+        const Instr& ins = *c.janela.obter(pc);
+        
+        // Instruções de load (carregamento imediato)
+        if(ins.tipo == TipoOp::LD) {
+            int idx = encontrar_buffer_carga_livre();
+            
+            int tag = alocar_rob(th);
+            
+            BufferCarga.ocupada.ligar(idx);
+            BufferCarga.executando.desligar(idx);
+            BufferCarga.op[idx] = TipoOp::LD;
+            BufferCarga.endereco[idx] = ins.imm;
+            BufferCarga.indice_rob[idx] = tag;
+            BufferCarga.Q[idx] = 0;
+            BufferCarga.V[idx] = 0;
+            BufferCarga.Qb[idx] = 0;
+            BufferCarga.Vb[idx] = 0;
+            BufferCarga.indireto.definir(idx, ins.src2 != SEM_BASE);
+            if(ins.src2 != SEM_BASE) ler_operando(c.arquivo_reg, ins.src2, BufferCarga.Vb[idx], BufferCarga.Qb[idx]);
+            BufferCarga.ciclosExecRestantes[idx] = 0;
+            
+            EntradaROB* r = entrada_rob(tag);
+            r->ocupada = true;
+            r->op = TipoOp::LD;
+            r->dest = ins.dest;
+            r->pronta = false;
+            r->valor = 0;
+            r->indice_instr = pc;
+            if(linha_tempo) linha_tempo->emitida(ciclo_atual, tag, pc, c.janela.texto(pc), Unidade::CARGA, idx, th);
+            
+            renomear_destino(c, *r, ins.dest, tag);
+            pc++;
+            return Parada::NENHUMA;
+        } 
+        // Instruções de store
+        else if(ins.tipo == TipoOp::ST) {
+            int idx = encontrar_buffer_arm_livre();
+            
+            int tag = alocar_rob(th);
+            
+            BufferArm.ocupada.ligar(idx);
+            BufferArm.executando.desligar(idx);
+            BufferArm.op[idx] = TipoOp::ST;
+            BufferArm.endereco[idx] = ins.imm;
+            BufferArm.indice_rob[idx] = tag;
+            BufferArm.V[idx] = 0;
+            BufferArm.Q[idx] = 0;
+            BufferArm.Vb[idx] = 0;
+            BufferArm.Qb[idx] = 0;
+            BufferArm.indireto.definir(idx, ins.src2 != SEM_BASE);
+            BufferArm.ciclosExecRestantes[idx] = 0;
+            
+            ler_operando(c.arquivo_reg, ins.src1, BufferArm.V[idx], BufferArm.Q[idx]);
+            if(ins.src2 != SEM_BASE) ler_operando(c.arquivo_reg, ins.src2, BufferArm.Vb[idx], BufferArm.Qb[idx]);
+            
+            EntradaROB* r = entrada_rob(tag);
+            r->ocupada = true;
+            r->op = TipoOp::ST;
+            r->dest = -1;
+            r->pronta = false;
+            // Com a base já disponível, o endereço é conhecido desde a emissão
+            r->endereco_pronto = BufferArm.Qb[idx] == 0;
+            r->endereco_mem = BufferArm.Vb[idx] + ins.imm;
+            r->indice_instr = pc;
+            if(linha_tempo) linha_tempo->emitida(ciclo_atual, tag, pc, c.janela.texto(pc), Unidade::ARM, idx, th);
+            
+            pc++;
+            return Parada::NENHUMA;
+        } 
+        // Desvio incondicional: resolvido na emissão, não executa
+        else if(ins.tipo == TipoOp::J) {
+            int tag = alocar_rob(th);
+            EntradaROB* r = entrada_rob(tag);
+            r->op = TipoOp::J;
+            r->dest = -1;
+            r->pronta = true;
+            r->indice_instr = pc;
+            if(linha_tempo) linha_tempo->emitida(ciclo_atual, tag, pc, c.janela.texto(pc), Unidade::NENHUMA, 0, th);
+            pc = ins.imm;
+            return Parada::NENHUMA;
+        }
+        // Instruções aritméticas e desvios condicionais
+        else if(ins.tipo == TipoOp::MUL || ins.tipo == TipoOp::DIV) {
+            emitir_aritmetica(RS_mul, encontrar_rs_livre(RS_mul), ins, Unidade::RS_MUL, th);
+        } else {
+            emitir_aritmetica(RS_soma, encontrar_rs_livre(RS_soma), ins, Unidade::RS_SOMA, th);
+        }
+        return Parada::NENHUMA;
+    }
+
+    // SMT: ordem em que as threads disputam a emissão neste ciclo. Rodízio:
+    // a partir da thread da vez; ICOUNT: primeiro a que tem menos instruções
+    // esperando ou executando nas estações e buffers (empates pelo rodízio)
+    void ordenar_threads() {
+        int n = num_threads();
+        for(int k = 0; k < n; k++) ordem_emissao[k] = (rodizio + k) % n;
+        if(cfg.politica_smt != POLITICA_SMT_ICOUNT || n == 1) return;
+        
+        std::array<int, MAX_THREADS_SMT> fila{};
+        auto contar = [&](const auto& banco) {
+            banco.ocupada.para_cada([&](size_t i) { fila[ROB[banco.indice_rob[i]].thread]++; });
+        };
+        contar(RS_soma);
+        contar(RS_mul);
+        contar(BufferCarga);
+        contar(BufferArm);
+        for(int k = 1; k < n; k++) {
+            int th = ordem_emissao[k], j = k;
+            for(; j > 0 && fila[ordem_emissao[j - 1]] > fila[th]; j--) ordem_emissao[j] = ordem_emissao[j - 1];
+            ordem_emissao[j] = th;
+        }
+    }
+
+    // Emite até LARGURA_EMISSAO instruções. Cada thread emite em ordem e
+    // para na primeira que não pode ser emitida, mesmo que alguma seguinte
+    // pudesse; a largura que sobra passa à próxima thread (ver ordenar_threads())
+    void emitir() {
+        emitidas_ciclo = 0;
+        Parada parada = Parada::NENHUMA;
+        ordenar_threads();
+        for(int k = 0; k < num_threads() && emitidas_ciclo < largura_emissao(); k++) {
+            int th = ordem_emissao[k];
+            ContextoThread& c = contextos[th];
+            Parada p = Parada::NENHUMA;
+            int antes = emitidas_ciclo;
+            while(emitidas_ciclo < largura_emissao() && 
+                  (p = emitir_uma(th)) == Parada::NENHUMA) {
+                emitidas_ciclo++;
+            }
+            c.emitidas += emitidas_ciclo - antes;
+            c.total_instr = c.janela.total();
+            parada = std::max(parada, p);
+        }
+        if(emitidas_ciclo == largura_emissao()) parada = Parada::NENHUMA;
+        est.emitidas += emitidas_ciclo;
+        est.emissao_por_ciclo[emitidas_ciclo]++;
+        if(parada != Parada::NENHUMA) est.paradas_emissao[(int)parada]++;
+    }
+
+    int latencia_op(TipoOp t) const {
+        switch(t) {
+            case TipoOp::ADD:
+            case TipoOp::SUB: return cfg.lat_soma;
+            case TipoOp::MUL: return cfg.lat_mul;
+            case TipoOp::DIV: return cfg.lat_div;
+            case TipoOp::LD: return cfg.lat_carga;
+            case TipoOp::ST: return cfg.lat_arm;
+            default: return 1;
+        }
+    }
+
+    // Soma n ciclos de ocupação e de espera por operandos de um banco
+    template<class Banco>
+    static void contar_ocupacao(const Banco& banco, ContadoresUnidade& c, long long n) {
+        c.ocupacao += n * banco.ocupada.contar();
+        c.executando += n * banco.executando.contar();
+        c.espera_operandos += n * banco.ocupada.contar_sem(banco.executando);
+    }
+
+    // Inicia a execução de todas as unidades com operandos disponíveis; as
+    // que continuam paradas contam como ciclos de espera por operandos
+    template<class Banco>
+    void tentar_iniciar(Banco& banco, ContadoresUnidade& c) {
+        banco.prontas().para_cada([&](size_t i) {
+            banco.executando.ligar(i);
+            banco.ciclosExecRestantes[i] = latencia_op(banco.op[i]);
+            if(linha_tempo) linha_tempo->iniciou(ciclo_atual, banco.indice_rob[i]);
+        });
+        contar_ocupacao(banco, c, 1);
+    }
+
+    template<class Banco>
+    void tentar_iniciar_rs(Banco& rsarr) {
+        bool soma = (const void*)&rsarr == &RS_soma;
+        int unidades = soma ? cfg.uf_soma : cfg.uf_mul;
+        if(unidades == 0) {
+            tentar_iniciar(rsarr, soma ? est.rs_soma : est.rs_mul);
+            return;
+        }
+        
+        // Unidades limitadas: cada uma aceita uma operação por ciclo, menos
+        // as que estão presas a uma DIV iterativa; as prontas mais antigas
+        // no ROB começam primeiro e as demais esperam uma unidade
+        int livres_uf = unidades;
+        if(!soma && cfg.div_iterativo) {
+            rsarr.executando.para_cada([&](size_t i) {
+                if(rsarr.op[i] == TipoOp::DIV && rsarr.ciclosExecRestantes[i] > 0) livres_uf--;
+            });
+        }
+        auto& prontas = rsarr.selecao;
+        rsarr.prontas();
+        for(; livres_uf > 0; livres_uf--) {
+            int escolhida = mais_antiga(rsarr, prontas);
+            if(escolhida < 0) break;
+            prontas.desligar(escolhida);
+            rsarr.executando.ligar(escolhida);
+            rsarr.ciclosExecRestantes[escolhida] = latencia_op(rsarr.op[escolhida]);
+            if(linha_tempo) linha_tempo->iniciou(ciclo_atual, rsarr.indice_rob[escolhida]);
+        }
+        (soma ? est.espera_uf_soma : est.espera_uf_mul) += prontas.contar();
+        contar_ocupacao(rsarr, soma ? est.rs_soma : est.rs_mul, 1);
+    }
+
+    // Posição da instrução na sua fila do ROB (0 = cabeça): a idade usada
+    // na seleção das unidades funcionais e do CDB
+    int idade_rob(int tag) const { return posicao_rob(particao(ROB[tag].thread), tag); }
+
+    // Entrada de 'conjunto' com a instrução mais antiga no ROB, ou -1
+    template<class Banco, class M>
+    int mais_antiga(const Banco& banco, const M& conjunto) const {
+        int escolhida = -1, menor = INT32_MAX;
+        conjunto.para_cada([&](size_t i) {
+            int idade = idade_rob(banco.indice_rob[i]);
+            if(idade < menor) {
+                menor = idade;
+                escolhida = (int)i;
+            }
+        });
+        return escolhida;
+    }
+
+    int ler_memoria(int endereco) const {
+        int v;
+        if(escritas_pendentes && escritas_pendentes->buscar((uint32_t)endereco, v)) return v;
+        return memoria->ler((uint32_t)endereco);
+    }
+
+    void gravar_memoria(int endereco, int valor) {
+        if(escritas_pendentes) escritas_pendentes->adicionar((uint32_t)endereco, valor);
+        else memoria->escrever((uint32_t)endereco, valor);
+    }
+
+    // Procura, entre os ST mais antigos que a carga 'tag', o mais novo que
+    // grava em 'endereco'. Se ele já tem o valor, a carga o recebe por
+    // encaminhamento (fonte = tag do ST); sem ST correspondente o valor vem
+    // da memória (fonte = 0). ST de endereço ainda desconhecido são
+    // ultrapassados especulativamente. Retorna false se o ST correspondente
+    // ainda espera o valor a gravar. Só os ST da mesma thread contam: os das
+    // outras só são vistos depois do commit, na memória.
+    bool consultar_lsq(int tag, int endereco, int& valor, int& fonte, bool& especulativa) const {
+        fonte = 0;
+        especulativa = false;
+        int th = ROB[tag].thread;
+        const ParticaoROB& p = particao(th);
+        for(int t = tag; t != p.cabeca; ) {
+            t = anterior_rob(p, t);
+            const EntradaROB& s = ROB[t];
+            if(s.op != TipoOp::ST || s.thread != th) continue;
+            if(!s.endereco_pronto) {
+                especulativa = true;
+                continue;
+            }
+            if(s.endereco_mem != endereco) continue;
+            fonte = t;
+            if(s.pronta) {
+                valor = s.valor_arm;
+                return true;
+            }
+            for(size_t i = 0; i < BufferArm.tamanho(); i++) {
+                if(BufferArm.ocupada.testar(i) && BufferArm.indice_rob[i] == t) {
+                    valor = BufferArm.V[i];
+                    return BufferArm.Q[i] == 0;
+                }
+            }
+            return false;
+        }
+        valor = ler_memoria(endereco);
+        return true;
+    }
+
+    // Carga do buffer i que já pode começar: imediata, ou com o valor
+    // disponível na memória ou num ST em voo
+    bool carga_pode_iniciar(size_t i) const {
+        if(!BufferCarga.indireto.testar(i)) return true;
+        int valor, fonte;
+        bool especulativa;
+        return consultar_lsq(BufferCarga.indice_rob[i], BufferCarga.Vb[i] + BufferCarga.endereco[i],
+                             valor, fonte, especulativa);
+    }
+
+    // Consulta a cache de dados no ciclo corrente: a latência do acesso, ou
+    // -1 se ele tem de esperar um MSHR
+    int acessar_cache(int endereco, bool escrita) {
+        int latencia = cache.acessar((uint32_t)endereco, escrita, ciclo_atual, est.cache_l1, est.cache_l2);
+        if(latencia < 0) est.espera_mshr++;
+        return latencia;
+    }
+
+    // Inicia a carga do buffer i, se ela já pode começar. Cargas da memória
+    // leem o valor ao iniciar e, com cache, levam a latência da consulta; as
+    // que o recebem de um ST em voo terminam em 1 ciclo
+    void iniciar_carga(size_t i) {
+        int latencia = cfg.lat_carga;
+        if(BufferCarga.indireto.testar(i)) {
+            int tag = BufferCarga.indice_rob[i];
+            int endereco = BufferCarga.Vb[i] + BufferCarga.endereco[i];
+            int fonte;
+            bool especulativa;
+            if(!consultar_lsq(tag, endereco, BufferCarga.V[i], fonte, especulativa)) return;
+            if(fonte != 0) latencia = 1;
+            else if(cache.ativa() && (latencia = acessar_cache(endereco, false)) < 0) return;
+            EntradaROB& r = ROB[tag];
+            r.endereco_mem = endereco;
+            r.endereco_pronto = true;
+            r.fonte_arm = fonte;
+            est.cargas_memoria++;
+            if(especulativa) est.cargas_especulativas++;
+            if(fonte != 0) est.cargas_encaminhadas++;
+        }
+        BufferCarga.executando.ligar(i);
+        BufferCarga.ciclosExecRestantes[i] = latencia;
+        if(linha_tempo) linha_tempo->iniciou(ciclo_atual, BufferCarga.indice_rob[i]);
+    }
+
+    // Com cache, as cargas prontas consultam a cache da mais antiga no ROB à
+    // mais nova, que é quem fica sem MSHR quando faltam
+    void tentar_iniciar_cargas() {
+        if(!cache.ativa()) {
+            BufferCarga.prontas().para_cada([&](size_t i) { iniciar_carga(i); });
+        } else {
+            auto& prontas = BufferCarga.selecao;
+            BufferCarga.prontas();
+            for(int i; (i = mais_antiga(BufferCarga, prontas)) >= 0; ) {
+                prontas.desligar(i);
+                iniciar_carga(i);
+            }
+        }
+        contar_ocupacao(BufferCarga, est.buffer_carga, 1);
+    }
+
+    // Calcula o endereço dos ST cuja base acabou de chegar e reexecuta a
+    // carga mais antiga que já leu esse endereço sem ver este ST
+    void resolver_enderecos_arm() {
+        if(BufferArm.indireto.vazia()) return;
+        for(size_t i = 0; i < BufferArm.tamanho(); i++) {
+            if(!BufferArm.ocupada.testar(i) || BufferArm.Qb[i] != 0) continue;
+            int tag = BufferArm.indice_rob[i];
+            EntradaROB& s = ROB[tag];
+            if(s.endereco_pronto) continue;
+            s.endereco_mem = BufferArm.Vb[i] + BufferArm.endereco[i];
+            s.endereco_pronto = true;
+            
+            const ParticaoROB& p = particao(s.thread);
+            int pos = posicao_rob(p, tag);
+            for(int t = proxima_rob(p, tag); t != p.cauda; t = proxima_rob(p, t)) {
+                const EntradaROB& c = ROB[t];
+                if(c.op != TipoOp::LD || c.thread != s.thread || !c.endereco_pronto ||
+                   c.endereco_mem != s.endereco_mem) continue;
+                // Valor encaminhado por um ST entre este e a carga continua certo
+                int pos_fonte = c.fonte_arm != 0 ? posicao_rob(p, c.fonte_arm) : -1;
+                if(pos_fonte > pos && pos_fonte < posicao_rob(p, t)) continue;
+                reexecutar_a_partir_de(t);
+                break;
+            }
+        }
+    }
+
+    // Descarta a instrução 'tag' e todas as posteriores e volta a buscar a
+    // partir dela
+    void reexecutar_a_partir_de(int tag) {
+        int th = ROB[tag].thread;
+        ContextoThread& c = contextos[th];
+        int indice = ROB[tag].indice_instr;
+        c.preditor.historico = ROB[tag].historico_antes;
+        est.reexecucoes++;
+        est.instrucoes_reexecutadas += descartar_apos(th, anterior_rob(particao(th), tag));
+        c.pc = indice;
+    }
+
+    // Com cache, cada ST pronto (endereço e valor conhecidos) a consulta
+    // como escrita, do mais antigo ao mais novo, e leva a latência dela
+    void tentar_iniciar_arms() {
+        resolver_enderecos_arm();
+        if(!cache.ativa()) {
+            tentar_iniciar(BufferArm, est.buffer_arm);
+            return;
+        }
+        auto& prontas = BufferArm.selecao;
+        BufferArm.prontas();
+        for(int i; (i = mais_antiga(BufferArm, prontas)) >= 0; ) {
+            prontas.desligar(i);
+            int latencia = acessar_cache(ROB[BufferArm.indice_rob[i]].endereco_mem, true);
+            if(latencia < 0) continue;
+            BufferArm.executando.ligar(i);
+            BufferArm.ciclosExecRestantes[i] = latencia;
+            if(linha_tempo) linha_tempo->iniciou(ciclo_atual, BufferArm.indice_rob[i]);
+        }
+        contar_ocupacao(BufferArm, est.buffer_arm, 1);
+    }
+
+    // Com o banco físico, o CDB leva o nº do registrador físico, não o do ROB
+    void transmitir_resultado(int tag_rob, int valor) {
+        int etiqueta = usa_fisicos() ? ROB[tag_rob].fisico : tag_rob;
+        RS_soma.capturar(etiqueta, valor);
+        RS_mul.capturar(etiqueta, valor);
+        BufferCarga.capturar(etiqueta, valor);
+        BufferArm.capturar(etiqueta, valor);
+        contextos[ROB[tag_rob].thread].arquivo_reg.capturar(etiqueta, valor);
+    }
+
+    // Escreve o resultado no ROB (ou no registrador físico) e o transmite no CDB
+    void escrever_resultado(int tag, int res) {
+        EntradaROB* r = entrada_rob(tag);
+        if(usa_fisicos()) {
+            valor_fisico[r->fisico] = res;
+            pronto_fisico.ligar(r->fisico);
+        } else {
+            r->valor = res;
+        }
+        r->pronta = true;
+        if(linha_tempo) linha_tempo->terminou(ciclo_atual, tag);
+        est.transmissoes_cdb++;
+        transmitir_resultado(tag, res);
+    }
+
+    // Resolve um desvio condicional; se a previsão errou, descarta as
+    // instruções posteriores e redireciona a busca
+    void resolver_desvio(int tag, bool tomado) {
+        EntradaROB& r = ROB[tag];
+        r.tomado = tomado;
+        r.pronta = true;
+        if(linha_tempo) linha_tempo->terminou(ciclo_atual, tag);
+        if(tomado == r.previsto_tomado) return;
+        
+        ContextoThread& c = contextos[r.thread];
+        c.preditor.registrar(r.historico_antes, tomado);
+        est.descartes++;
+        est.instrucoes_descartadas += descartar_apos(r.thread, tag);
+        c.pc = tomado ? c.janela.obter(r.indice_instr)->imm : r.indice_instr + 1;
+    }
+
+    // Descarta as instruções da thread th posteriores à entrada 'tag', libera
+    // suas estações e buffers e refaz as tags dos registradores da thread a
+    // partir das entradas que sobraram (com o banco físico, desfaz os
+    // mapeamentos da mais nova para a mais antiga e devolve os físicos à
+    // lista livre). No ROB compartilhado, as entradas das outras threads
+    // ficam e as descartadas viram buracos, liberados quando chegam à
+    // cabeça; a cauda só recua sobre os buracos do fim. Retorna quantas
+    // entradas foram descartadas
+    int descartar_apos(int th, int tag) {
+        ParticaoROB& p = particao(th);
+        int limite = posicao_rob(p, tag);
+        auto descartada = [&](int t) { return ROB[t].thread == th && posicao_rob(p, t) > limite; };
+        auto descartar_rs = [&](auto& rs) {
+            for(size_t i = 0; i < rs.tamanho(); i++) {
+                if(rs.ocupada.testar(i) && descartada(rs.indice_rob[i])) {
+                    rs.liberar(i);
+                    rs.Qj[i] = rs.Qk[i] = 0;
+                }
+            }
+        };
+        auto descartar_buffers = [&](auto& b) {
+            for(size_t i = 0; i < b.tamanho(); i++) {
+                if(b.ocupada.testar(i) && descartada(b.indice_rob[i])) {
+                    b.liberar(i);
+                    b.Q[i] = b.Qb[i] = 0;
+                }
+            }
+        };
+        descartar_rs(RS_soma);
+        descartar_rs(RS_mul);
+        descartar_buffers(BufferCarga);
+        descartar_buffers(BufferArm);
+        
+        BancoRegistradores& regs = contextos[th].arquivo_reg;
+        if(usa_fisicos()) {
+            for(int t = anterior_rob(p, p.cauda); t != tag; t = anterior_rob(p, t)) {
+                if(!da_thread(t, th) || ROB[t].fisico == 0) continue;
+                regs.tag[ROB[t].dest] = ROB[t].fisico_anterior;
+                livres[n_livres++] = ROB[t].fisico;
+            }
+        }
+        
+        int descartadas = 0;
+        for(int t = proxima_rob(p, tag); t != p.cauda; t = proxima_rob(p, t)) {
+            if(!da_thread(t, th)) continue;
+            if(linha_tempo) linha_tempo->descartada(ciclo_atual, t);
+            ROB[t] = EntradaROB();
+            descartadas++;
+        }
+        while(p.cauda != p.cabeca && !ROB[anterior_rob(p, p.cauda)].ocupada) p.cauda = anterior_rob(p, p.cauda);
+        
+        if(usa_fisicos()) {
+            for(int i = 0; i < REGISTRADORES; i++) {
+                int f = regs.tag[i];
+                regs.valor[i] = pronto_fisico.testar(f) ? valor_fisico[f] : regs.consolidado[i];
+            }
+            return descartadas;
+        }
+        regs.tag.fill(0);
+        for(int t = p.cabeca; t != p.cauda; t = proxima_rob(p, t)) {
+            if(da_thread(t, th) && ROB[t].dest >= 0) regs.tag[ROB[t].dest] = t;
+        }
+        for(int i = 0; i < REGISTRADORES; i++) {
+            int t = regs.tag[i];
+            regs.valor[i] = t != 0 && ROB[t].pronta ? ROB[t].valor : regs.consolidado[i];
+        }
+        return descartadas;
+    }
+
+    static int resultado_aritmetico(TipoOp op, int a, int b) {
+        switch(op) {
+            case TipoOp::ADD: return a + b;
+            case TipoOp::SUB: return a - b;
+            case TipoOp::MUL: return a * b;
+            case TipoOp::DIV: return b != 0 ? a / b : 0;
+            default: return 0;
+        }
+    }
+
+    // Resolve o desvio que terminou na estação i de RS_soma
+    void terminar_desvio(size_t i) {
+        int tag = RS_soma.indice_rob[i];
+        RS_soma.liberar(i);
+        resolver_desvio(tag, (RS_soma.Vj[i] == RS_soma.Vk[i]) == (RS_soma.op[i] == TipoOp::BEQ));
+    }
+
+    int valor_carga(size_t i) const {
+        return BufferCarga.indireto.testar(i) ? BufferCarga.V[i] : BufferCarga.endereco[i];
+    }
+
+    // Stores terminados ficam prontos no ROB, sem passar pelo CDB
+    void terminar_arms() {
+        BufferArm.descontar(1);
+        BufferArm.terminadas().para_cada([&](size_t i) {
+            EntradaROB* r = entrada_rob(BufferArm.indice_rob[i]);
+            r->pronta = true;
+            r->valor_arm = BufferArm.V[i];
+            if(linha_tempo) linha_tempo->terminou(ciclo_atual, BufferArm.indice_rob[i]);
+            BufferArm.liberar(i);
+        });
+    }
+
+    void avancar_execucao_e_escrever(int ciclo) {
+        if(cfg.barramentos_cdb > 0) {
+            avancar_com_cdb_limitado();
+            return;
+        }
+        
+        // Execução nas estações de reserva de soma/subtração (e desvios)
+        RS_soma.descontar(1);
+        RS_soma.terminadas().para_cada([&](size_t i) {
+            // Descartada por um desvio resolvido antes, neste mesmo ciclo
+            if(!RS_soma.ocupada.testar(i)) return;
+            if(eh_desvio(RS_soma.op[i])) {
+                terminar_desvio(i);
+                return;
+            }
+            escrever_resultado(RS_soma.indice_rob[i], resultado_aritmetico(RS_soma.op[i], RS_soma.Vj[i], RS_soma.Vk[i]));
+            RS_soma.liberar(i);
+        });
+        
+        // Execução nas estações de reserva de multiplicação/divisão
+        RS_mul.descontar(1);
+        RS_mul.terminadas().para_cada([&](size_t i) {
+            escrever_resultado(RS_mul.indice_rob[i], resultado_aritmetico(RS_mul.op[i], RS_mul.Vj[i], RS_mul.Vk[i]));
+            RS_mul.liberar(i);
+        });
+        
+        // Execução de loads (carregamento imediato)
+        BufferCarga.descontar(1);
+        BufferCarga.terminadas().para_cada([&](size_t i) {
+            escrever_resultado(BufferCarga.indice_rob[i], valor_carga(i));
+            BufferCarga.liberar(i);
+        });
+        
+        terminar_arms();
+    }
+
+    // Com BARRAMENTOS_CDB > 0: os desvios (que não transmitem nada) são
+    // resolvidos primeiro; depois os resultados terminados disputam os
+    // barramentos, do mais antigo no ROB ao mais novo, e os que perdem
+    // esperam na estação ou buffer até o ciclo seguinte
+    void avancar_com_cdb_limitado() {
+        RS_soma.descontar(1);
+        RS_mul.descontar(1);
+        BufferCarga.descontar(1);
+        RS_soma.terminadas().para_cada([&](size_t i) {
+            if(RS_soma.ocupada.testar(i) && eh_desvio(RS_soma.op[i])) terminar_desvio(i);
+        });
+        
+        // Um desvio mal previsto pode ter descartado entradas terminadas
+        RS_soma.terminadas();
+        RS_mul.terminadas();
+        BufferCarga.terminadas();
+        auto& soma = RS_soma.selecao;
+        auto& mul = RS_mul.selecao;
+        auto& carga = BufferCarga.selecao;
+        for(int b = 0; b < cfg.barramentos_cdb; b++) {
+            int i_soma = mais_antiga(RS_soma, soma);
+            int i_mul = mais_antiga(RS_mul, mul);
+            int i_carga = mais_antiga(BufferCarga, carga);
+            auto idade = [&](const auto& banco, int i) { return i < 0 ? INT32_MAX : idade_rob(banco.indice_rob[i]); };
+            int a_soma = idade(RS_soma, i_soma), a_mul = idade(RS_mul, i_mul), a_carga = idade(BufferCarga, i_carga);
+            if(i_soma >= 0 && a_soma <= a_mul && a_soma <= a_carga) {
+                escrever_resultado(RS_soma.indice_rob[i_soma],
+                                   resultado_aritmetico(RS_soma.op[i_soma], RS_soma.Vj[i_soma], RS_soma.Vk[i_soma]));
+                RS_soma.liberar(i_soma);
+                soma.desligar(i_soma);
+            } else if(i_mul >= 0 && a_mul <= a_carga) {
+                escrever_resultado(RS_mul.indice_rob[i_mul],
+                                   resultado_aritmetico(RS_mul.op[i_mul], RS_mul.Vj[i_mul], RS_mul.Vk[i_mul]));
+                RS_mul.liberar(i_mul);
+                mul.desligar(i_mul);
+            } else if(i_carga >= 0) {
+                escrever_resultado(BufferCarga.indice_rob[i_carga], valor_carga(i_carga));
+                BufferCarga.liberar(i_carga);
+                carga.desligar(i_carga);
+            } else {
+                break;
+            }
+        }
+        est.espera_cdb += soma.contar() + mul.contar() + carga.contar();
+        
+        terminar_arms();
+    }
+
+    // Consolida a entrada na cabeça da fila p, se estiver pronta
+    bool consolidar_uma(ParticaoROB& p) {
+        if(ROB[p.cabeca].ocupada && ROB[p.cabeca].pronta) {
+            EntradaROB& r = ROB[p.cabeca];
+            ContextoThread& c = contextos[r.thread];
+            
+            // Instruções de store: escrever na memória
+            if(r.op == TipoOp::ST) {
+                gravar_memoria(r.endereco_mem, r.valor_arm);
+            } 
+            // Desvios: treinam o preditor, que só aprende com o caminho correto
+            else if(r.op == TipoOp::BEQ || r.op == TipoOp::BNE) {
+                est.desvios++;
+                if(r.tomado != r.previsto_tomado) est.desvios_mal_previstos++;
+                c.preditor.treinar(r.indice_preditor, r.tomado);
+            }
+            // Outras instruções: atualizar registradores
+            else if(escreve_registrador(r.op)) {
+                int dest = r.dest;
+                if(dest >= 0 && dest < REGISTRADORES && usa_fisicos()) {
+                    c.arquivo_reg.consolidado[dest] = valor_fisico[r.fisico];
+                    livres[n_livres++] = r.fisico_anterior;
+                } else if(dest >= 0 && dest < REGISTRADORES) {
+                    c.arquivo_reg.consolidado[dest] = r.valor;
+                    if(c.arquivo_reg.tag[dest] == p.cabeca) {
+                        c.arquivo_reg.valor[dest] = r.valor;
+                        c.arquivo_reg.tag[dest] = 0;
+                    }
+                }
+            }
+            c.consolidadas++;
+            c.ciclo_fim = ciclo_atual;
+            if(!pontos.empty()) verificar_commit(r);
+            if(laco.exigidas > 0 && !laco.detectado && eh_desvio(r.op)) marcar_fronteira(c, r);
+            // Instruções já consolidadas saem da janela de busca
+            c.janela.liberar_ate(r.indice_instr + 1);
+            
+            // Libera entrada do ROB e os buracos deixados por descartes
+            if(linha_tempo) linha_tempo->consolidada(ciclo_atual, p.cabeca);
+            r = EntradaROB();
+            do {
+                p.cabeca = proxima_rob(p, p.cabeca);
+            } while(p.cabeca != p.cauda && !ROB[p.cabeca].ocupada);
+            return true;
+        }
+        return false;
+    }
+
+    // Desvio para trás tomado: fim de uma iteração de laço, examinada no fim
+    // do ciclo por verificar_fronteira()
+    void marcar_fronteira(ContextoThread& c, const EntradaROB& r) {
+        if(r.op != TipoOp::J && !r.tomado) return;
+        int alvo = c.janela.obter(r.indice_instr)->imm;
+        if(alvo > r.indice_instr) return;
+        laco.pendente = true;
+        laco.pc_pendente = r.indice_instr;
+        laco.alvo_pendente = alvo;
+    }
+
+    // Consolida até LARGURA_COMMIT entradas prontas, em ordem, a partir da
+    // cabeça; com várias filas (SMT particionado), a partir da fila da vez
+    void consolidar() {
+        est.ocupacao_rob += ocupadas_rob();
+        est.fisicos_livres += n_livres;
+        consolidadas_ciclo = 0;
+        int n = (int)particoes.size();
+        for(int k = 0; k < n; k++) {
+            ParticaoROB& p = particoes[(rodizio + k) % n];
+            while(consolidadas_ciclo < largura_commit() && consolidar_uma(p)) {
+                consolidadas_ciclo++;
+            }
+        }
+        est.consolidadas += consolidadas_ciclo;
+        est.commit_por_ciclo[consolidadas_ciclo]++;
+        
+        int cabeca = cabeca_principal();
+        if(consolidadas_ciclo == 0 && ROB[cabeca].ocupada) {
+            est.cabeca_bloqueada[(int)ROB[cabeca].op]++;
+        }
+        contabilizar_cpi(consolidadas_ciclo, 1);
+        rodizio = num_threads() > 1 ? (rodizio + 1) % num_threads() : 0;
+    }
+
+    // Distribui n ciclos com k commits cada entre as parcelas da pilha de CPI
+    void contabilizar_cpi(int k, long long n) {
+        double util = (double)k / largura_commit();
+        est.cpi_base += n * util;
+        if(k < largura_commit()) {
+            double perdido = n * (1.0 - util);
+            int cabeca = cabeca_principal();
+            if(ROB[cabeca].ocupada) est.cpi_cabeca[(int)ROB[cabeca].op] += perdido;
+            else est.cpi_rob_vazio += perdido;
+        }
+    }
+
+
+    void imprimir_estado(int ciclo) const {
+        printf("------------------------------------------------------------\n");
+        printf("CICLO: %d\n", ciclo);
+        for(int th = 0; th < num_threads(); th++) {
+            const ContextoThread& c = contextos[th];
+            if(num_threads() > 1) printf("Thread %d ", th);
+            if(c.total_instr >= 0) printf("PC: %d / %d\n", c.pc, c.total_instr);
+            else printf("PC: %d / ?\n", c.pc);
+        }
+        printf("Ciclo anterior: emitidas %d/%d, consolidadas %d/%d\n",
+               emitidas_ciclo, largura_emissao(), consolidadas_ciclo, largura_commit());
+        
+        printf("\nESTACOES DE RESERVA (ADD/SUB):\n");
+        printf("Idx | Ocup | Op  | Vj   | Vk   | Qj | Qk | ROB\n");
+        for(size_t i = 0; i < RS_soma.tamanho(); i++) {
+            bool ocupada = RS_soma.ocupada.testar(i);
+            printf("%3zu |  %3d | %3s | %4d | %4d | %2d | %2d | %2d\n",
+                i, ocupada ? 1 : 0, ocupada ? nomeOp(RS_soma.op[i]) : "--",
+                RS_soma.Vj[i], RS_soma.Vk[i], RS_soma.Qj[i], RS_soma.Qk[i], 
+                RS_soma.indice_rob[i]);
+        }
+        
+        printf("\nESTACOES DE RESERVA (MUL/DIV):\n");
+        printf("Idx | Ocup | Op  | Vj   | Vk   | Qj | Qk | ROB\n");
+        for(size_t i = 0; i < RS_mul.tamanho(); i++) {
+            bool ocupada = RS_mul.ocupada.testar(i);
+            printf("%3zu |  %3d | %3s | %4d | %4d | %2d | %2d | %2d\n",
+                i, ocupada ? 1 : 0, ocupada ? nomeOp(RS_mul.op[i]) : "--",
+                RS_mul.Vj[i], RS_mul.Vk[i], RS_mul.Qj[i], RS_mul.Qk[i], 
+                RS_mul.indice_rob[i]);
+        }
+        
+        // Imm é o imediato de LD Rd, imm ou o deslocamento de LD Rd, desl(Rb),
+        // cuja base é Vb/Qb (- sem base)
+        printf("\nBUFFERS DE CARGA (imediato ou memoria em desl(Rb), via LSQ):\n");
+        printf("Idx | Ocup | Imm  | Vb   | Qb | ROB | ExecRest\n");
+        for(size_t i = 0; i < BufferCarga.tamanho(); i++) {
+            printf("%3zu |  %3d | %4d | ", i, BufferCarga.ocupada.testar(i) ? 1 : 0, BufferCarga.endereco[i]);
+            if(BufferCarga.indireto.testar(i)) printf("%4d | %2d", BufferCarga.Vb[i], BufferCarga.Qb[i]);
+            else printf("%4s | %2s", "-", "-");
+            printf(" |  %2d | %3d\n", BufferCarga.indice_rob[i], BufferCarga.ciclosExecRestantes[i]);
+        }
+        
+        printf("\nBUFFERS DE ARMAZENAMENTO:\n");
+        printf("Idx | Ocup | Endr | V | Q | ROB | ExecRest\n");
+        for(size_t i = 0; i < BufferArm.tamanho(); i++) {
+            printf("%3zu |  %3d | %4d | %2d | %2d | %2d | %3d\n",
+                i, BufferArm.ocupada.testar(i) ? 1 : 0, BufferArm.endereco[i], 
+                BufferArm.V[i], BufferArm.Q[i], BufferArm.indice_rob[i], 
+                BufferArm.ciclosExecRestantes[i]);
+        }
+        
+        if(num_threads() == 1) printf("\nROB (cabeca=%d cauda=%d):\n", particoes[0].cabeca, particoes[0].cauda);
+        else {
+            printf("\nROB (%s):", NOMES_ROB_SMT[cfg.rob_smt]);
+            for(const auto& p : particoes) printf(" [%d-%d] cabeca=%d cauda=%d", p.inicio, p.fim, p.cabeca, p.cauda);
+            printf("\n");
+        }
+        printf("Idx | Ocup | Op  | Dest | Pronta | Valor | Instr\n");
+        for(int i = 1; i <= tam_rob(); i++) {
+            const EntradaROB& r = ROB[i];
+            if(r.ocupada) {
+                printf("%3d |  %3d | %3s |  %3d |   %3d | %5d | ", 
+                    i, r.ocupada ? 1 : 0, nomeOp(r.op), r.dest, r.pronta ? 1 : 0, resultado_rob(i));
+                if(num_threads() > 1) printf("T%d ", r.thread);
+                printf("%s\n", texto_instr(r.thread, r.indice_instr));
+            }
+        }
+        
+        imprimir_registradores();
+        imprimir_memoria(*memoria);
+        printf("\n------------------------------------------------------------\n");
+    }
+
+    void imprimir_registradores() const {
+        for(int th = 0; th < num_threads(); th++) {
+            const BancoRegistradores& regs = contextos[th].arquivo_reg;
+            const char* tag = usa_fisicos() ? "fisico" : "tag";
+            if(num_threads() > 1) printf("\nRegistradores da thread %d (valor : %s):\n", th, tag);
+            else printf("\nRegistradores (valor : %s):\n", tag);
+            for(int i = 0; i < REGISTRADORES; i++) {
+                printf("R%02d=%5d : t=%2d\t", i, regs.valor[i], regs.tag[i]);
+                if((i + 1) % 4 == 0) printf("\n");
+            }
+        }
+    }
+
+    void imprimir_amostragem() const {
+        const ResultadoAmostragem& a = amostragem;
+        printf("\nAMOSTRAGEM:\n");
+        printf("  %-22s %12lld\n", "instrucoes", a.instrucoes());
+        printf("  %-22s %12lld  (%.1f%%)\n", "funcionais", a.instrucoes_funcionais,
+               a.instrucoes() > 0 ? 100.0 * a.instrucoes_funcionais / a.instrucoes() : 0.0);
+        printf("  %-22s %12lld\n", "detalhadas", a.instrucoes_detalhadas);
+        printf("  %-22s %12zu\n", "janelas medidas", a.cpi.size());
+        if(a.cpi.empty()) {
+            printf("  nenhuma janela medida: programa curto demais para o intervalo\n");
+            return;
+        }
+        double cpi = a.cpi_medio(), h = a.meia_largura();
+        printf("  %-22s %12.4f +- %.4f (IC 95%%)\n", "CPI", cpi, h);
+        printf("  %-22s %12.0f +- %.0f (+-%.2f%%)\n", "ciclos estimados", cpi * a.instrucoes(),
+               h * a.instrucoes(), cpi > 0 ? 100.0 * h / cpi : 0.0);
+        printf("  %-22s %12.4f\n", "IPC estimado", cpi > 0 ? 1.0 / cpi : 0.0);
+    }
+
+    void imprimir_extrapolacao() const {
+        const ResultadoExtrapolacao& x = extrapolacao;
+        printf("\nEXTRAPOLACAO DE LACOS:\n");
+        printf("  %-22s %12lld\n", "lacos extrapolados", x.lacos);
+        printf("  %-22s %12.1f\n", "iteracoes", x.iteracoes);
+        printf("  %-22s %12lld  (%.1f%%)\n", "instrucoes", x.instrucoes,
+               est.consolidadas > 0 ? 100.0 * x.instrucoes / est.consolidadas : 0.0);
+        printf("  %-22s %12lld\n", "funcionais", x.instrucoes_funcionais);
+        printf("  %-22s %12lld  (%.1f%%)\n", "ciclos extrapolados", x.ciclos,
+               est.ciclos > 0 ? 100.0 * x.ciclos / est.ciclos : 0.0);
+    }
+
+    void imprimir_estatisticas() const {
+        if(amostragem.ativa) imprimir_amostragem();
+        if(extrapolacao.ativa) imprimir_extrapolacao();
+        printf("\nESTATISTICAS%s:\n", amostragem.ativa ? " (so o modelo detalhado)" : "");
+        printf("Instrucoes consolidadas: %lld em %lld ciclos (IPC = %.3f)\n",
+               est.consolidadas, est.ciclos, 
+               est.ciclos > 0 ? (double)est.consolidadas / est.ciclos : 0.0);
+        printf("Largura: emissao %d, commit %d\n", largura_emissao(), largura_commit());
+        printf("Ciclos por nº de instrucoes emitidas:    ");
+        for(size_t k = 0; k < est.emissao_por_ciclo.size(); k++) {
+            printf(" %zu:%lld", k, est.emissao_por_ciclo[k]);
+        }
+        printf("\nCiclos por nº de instrucoes consolidadas:");
+        for(size_t k = 0; k < est.commit_por_ciclo.size(); k++) {
+            printf(" %zu:%lld", k, est.commit_por_ciclo[k]);
+        }
+        printf("\n");
+        
+        double n = est.consolidadas > 0 ? (double)est.consolidadas : 1.0;
+        double ciclos = est.ciclos > 0 ? (double)est.ciclos : 1.0;
+        printf("\nPILHA DE CPI (CPI = %.3f):\n", est.ciclos / n);
+        auto parcela = [&](const char* nome, double c) {
+            if(c > 0) printf("  %-22s %8.3f  %5.1f%%\n", nome, c / n, 100.0 * c / ciclos);
+        };
+        parcela("base (commit)", est.cpi_base);
+        for(int t = 0; t < NUM_TIPOS_OP; t++) {
+            std::string nome = std::string("cabeca ROB: ") + nomeOp((TipoOp)t);
+            parcela(nome.c_str(), est.cpi_cabeca[t]);
+        }
+        parcela("ROB vazio", est.cpi_rob_vazio);
+        
+        printf("\nPARADAS DE EMISSAO (ciclos):\n");
+        for(int p = (int)Parada::ROB_CHEIO; p < (int)Parada::NUM_PARADAS; p++) {
+            printf("  %-22s %8lld\n", NOMES_PARADA[p], est.paradas_emissao[p]);
+        }
+        
+        printf("\nCABECA DO ROB BLOQUEADA (ciclos sem commit):\n");
+        for(int t = 0; t < NUM_TIPOS_OP; t++) {
+            if(est.cabeca_bloqueada[t] > 0) printf("  %-22s %8lld\n", nomeOp((TipoOp)t), est.cabeca_bloqueada[t]);
+        }
+        
+        if(est.desvios > 0 || est.descartes > 0) {
+            printf("\nDESVIOS (preditor %s):\n", NOMES_PREDITOR[cfg.preditor]);
+            printf("  %-22s %8lld\n", "consolidados", est.desvios);
+            printf("  %-22s %8lld  (%.1f%% de acerto)\n", "mal previstos", est.desvios_mal_previstos,
+                   est.desvios > 0 ? 100.0 * (est.desvios - est.desvios_mal_previstos) / est.desvios : 0.0);
+            printf("  %-22s %8lld\n", "descartes do ROB", est.descartes);
+            printf("  %-22s %8lld\n", "instr. descartadas", est.instrucoes_descartadas);
+        }
+        
+        if(est.cargas_memoria > 0) {
+            printf("\nFILA DE CARGAS/ARMAZENAMENTOS:\n");
+            printf("  %-22s %8lld\n", "cargas da memoria", est.cargas_memoria);
+            printf("  %-22s %8lld\n", "encaminhadas de ST", est.cargas_encaminhadas);
+            printf("  %-22s %8lld\n", "especulativas", est.cargas_especulativas);
+            printf("  %-22s %8lld\n", "reexecucoes", est.reexecucoes);
+            printf("  %-22s %8lld\n", "instr. reexecutadas", est.instrucoes_reexecutadas);
+        }
+        
+        printf("\nOCUPACAO MEDIA POR CICLO:\n");
+        printf("Estrutura    | Entradas | Ocupadas | Executando | Esperando operandos\n");
+        auto unidade = [&](const char* nome, const ContadoresUnidade& c, size_t tamanho) {
+            printf("%-12s | %8zu | %8.2f | %10.2f | %8.2f\n", nome, tamanho,
+                   c.ocupacao / ciclos, c.executando / ciclos, c.espera_operandos / ciclos);
+        };
+        unidade("RS soma", est.rs_soma, RS_soma.tamanho());
+        unidade("RS mul", est.rs_mul, RS_mul.tamanho());
+        unidade("Buf. carga", est.buffer_carga, BufferCarga.tamanho());
+        unidade("Buf. arm.", est.buffer_arm, BufferArm.tamanho());
+        printf("%-12s | %8d | %8.2f |\n", "ROB", capacidade_rob(), est.ocupacao_rob / ciclos);
+        
+        if(cfg.uf_soma > 0 || cfg.uf_mul > 0 || cfg.barramentos_cdb > 0) {
+            auto limite = [](int n) { if(n > 0) printf("%8d\n", n); else printf("%8s\n", "-"); };
+            printf("\nUNIDADES FUNCIONAIS E CDB (- = sem limite):\n");
+            printf("  %-22s ", "unidades de soma");
+            limite(cfg.uf_soma);
+            printf("  %-22s ", cfg.div_iterativo ? "unidades mul (DIV it.)" : "unidades de mul/div");
+            limite(cfg.uf_mul);
+            printf("  %-22s ", "barramentos do CDB");
+            limite(cfg.barramentos_cdb);
+            printf("  %-22s %8lld\n", "sem unidade (soma)", est.espera_uf_soma);
+            printf("  %-22s %8lld\n", "sem unidade (mul/div)", est.espera_uf_mul);
+            printf("  %-22s %8lld\n", "esperando o CDB", est.espera_cdb);
+            printf("  %-22s %8.3f\n", "transmissoes/ciclo", est.transmissoes_cdb / ciclos);
+        }
+        
+        if(cache.ativa()) {
+            printf("\nCACHE DE DADOS (linha de %d palavras, memoria em %d ciclos):\n", cfg.linha_cache, cfg.lat_memoria);
+            printf("%-4s | %8s | %5s | %4s | %10s | %10s | %7s | %10s | %10s\n",
+                   "Niv.", "Palavras", "Assoc", "Lat.", "Acessos", "Faltas", "Taxa %", "Pendentes", "Esc. volta");
+            auto nivel = [](const char* nome, int tamanho, int assoc, int lat, const ContadoresCache& c) {
+                printf("%-4s | %8d | %5d | %4d | %10lld | %10lld | %7.2f | %10lld | %10lld\n", nome, tamanho, assoc, lat,
+                       c.acessos, c.faltas, c.acessos ? 100.0 * c.faltas / c.acessos : 0.0, c.pendentes, c.escritas_volta);
+            };
+            nivel("L1", cfg.l1_tamanho, cfg.l1_assoc, cfg.l1_lat, est.cache_l1);
+            if(cfg.l2_tamanho > 0) nivel("L2", cfg.l2_tamanho, cfg.l2_assoc, cfg.l2_lat, est.cache_l2);
+            printf("  %-22s ", "MSHRs");
+            if(cfg.mshrs > 0) printf("%8d\n", cfg.mshrs); else printf("%8s\n", "-");
+            printf("  %-22s %8lld\n", "esperando MSHR", est.espera_mshr);
+        }
+        
+        printf("\nRENOMEACAO (%s):\n", usa_fisicos() ? "banco de registradores fisicos" : "valores no ROB");
+        if(usa_fisicos()) {
+            printf("  %-22s %8d\n", "registradores fisicos", cfg.regs_fisicos);
+            printf("  %-22s %8.2f\n", "livres (media)", est.fisicos_livres / ciclos);
+        }
+        printf("  %-22s %8lld\n", "bits de armazenamento", bits_renomeacao());
+        if(num_threads() > 1) imprimir_threads();
+    }
+
+    /* Custo de armazenamento da renomeação, em bits: só o que muda entre os
+       dois esquemas. Com valores no ROB, os valores das entradas, o banco
+       arquitetural e uma tag do ROB por registrador; com o banco físico, os
+       registradores físicos, a tabela de mapeamento, a lista livre e os dois
+       nºs de registrador físico de cada entrada do ROB. */
+    long long bits_renomeacao() const {
+        auto bits = [](long long n) { int b = 0; while((1LL << b) < n) b++; return (long long)b; };
+        long long regs = (long long)REGISTRADORES * num_threads();
+        if(!usa_fisicos()) return tam_rob() * 32LL + regs * 32 + regs * bits(tam_rob() + 1);
+        long long p = cfg.regs_fisicos, b = bits(p + 1);
+        return p * 32 + regs * b + p * b + 2LL * tam_rob() * b;
+    }
+
+    // SMT: IPC de cada thread até o ciclo do seu último commit (a que termina
+    // antes não é penalizada pelos ciclos das outras) e, com o IPC de cada
+    // programa sozinho (definir_ipc_isolado()), o IPC relativo, o speedup
+    // ponderado (soma dos relativos) e a justiça (menor / maior relativo)
+    double ipc_thread(int th) const {
+        const ContextoThread& c = contextos[th];
+        return c.ciclo_fim > 0 ? (double)c.consolidadas / c.ciclo_fim : 0.0;
+    }
+
+    double ipc_relativo(int th) const {
+        return th < (int)ipc_isolado.size() && ipc_isolado[th] > 0 ? ipc_thread(th) / ipc_isolado[th] : 0.0;
+    }
+
+    void metricas_smt(double& speedup, double& justica, double& harmonica) const {
+        double menor = INFINITY, maior = 0, inversos = 0;
+        speedup = 0;
+        for(int th = 0; th < num_threads(); th++) {
+            double r = ipc_relativo(th);
+            speedup += r;
+            menor = std::min(menor, r);
+            maior = std::max(maior, r);
+            inversos += r > 0 ? 1.0 / r : INFINITY;
+        }
+        justica = maior > 0 ? menor / maior : 0.0;
+        harmonica = num_threads() / inversos;
+    }
+
+    void definir_ipc_isolado(std::vector<double> ipc) { ipc_isolado = std::move(ipc); }
+
+    void imprimir_threads() const {
+        printf("\nTHREADS (SMT: ROB %s, emissao por %s):\n", NOMES_ROB_SMT[cfg.rob_smt],
+               NOMES_POLITICA_SMT[cfg.politica_smt]);
+        printf("Thread | Emitidas | Consolidadas | Ciclo fim |   IPC | IPC isolado | Relativo\n");
+        for(int th = 0; th < num_threads(); th++) {
+            const ContextoThread& c = contextos[th];
+            printf("%6d | %8lld | %12lld | %9lld | %5.3f", th, c.emitidas, c.consolidadas, c.ciclo_fim, ipc_thread(th));
+            if(ipc_isolado.empty()) printf(" |           - |        -\n");
+            else printf(" | %11.3f | %8.3f\n", ipc_isolado[th], ipc_relativo(th));
+        }
+        if(ipc_isolado.empty()) return;
+        double speedup, justica, harmonica;
+        metricas_smt(speedup, justica, harmonica);
+        printf("Speedup ponderado: %.3f   Justica (min/max relativo): %.3f   Media harmonica: %.3f\n",
+               speedup, justica, harmonica);
+    }
+
+    // Mesmas estatísticas de imprimir_estatisticas(), em JSON
+    void escrever_estatisticas_json(FILE* out) const {
+        fprintf(out, "{\n  \"ciclos\": %lld,\n  \"emitidas\": %lld,\n  \"consolidadas\": %lld,\n",
+                est.ciclos, est.emitidas, est.consolidadas);
+        fprintf(out, "  \"ipc\": %.6f,\n", est.ciclos > 0 ? (double)est.consolidadas / est.ciclos : 0.0);
+        if(amostragem.ativa) {
+            const ResultadoAmostragem& a = amostragem;
+            double cpi = a.cpi_medio(), h = a.meia_largura();
+            fprintf(out, "  \"amostragem\": {\"instrucoes\": %lld, \"funcionais\": %lld, \"detalhadas\": %lld, "
+                         "\"janelas\": %zu, \"cpi\": %.6f, \"cpi_ic95\": %.6f, "
+                         "\"ciclos_estimados\": %.1f, \"ciclos_ic95\": %.1f},\n",
+                    a.instrucoes(), a.instrucoes_funcionais, a.instrucoes_detalhadas, a.cpi.size(),
+                    cpi, h, cpi * a.instrucoes(), h * a.instrucoes());
+        }
+        if(extrapolacao.ativa) {
+            const ResultadoExtrapolacao& x = extrapolacao;
+            fprintf(out, "  \"extrapolacao\": {\"lacos\": %lld, \"iteracoes\": %.1f, \"instrucoes\": %lld, "
+                         "\"funcionais\": %lld, \"ciclos\": %lld},\n",
+                    x.lacos, x.iteracoes, x.instrucoes, x.instrucoes_funcionais, x.ciclos);
+        }
+        
+        double n = est.consolidadas > 0 ? (double)est.consolidadas : 1.0;
+        fprintf(out, "  \"pilha_cpi\": {\"base\": %.6f", est.cpi_base / n);
+        for(int t = 0; t < NUM_TIPOS_OP; t++) {
+            fprintf(out, ", \"cabeca_%s\": %.6f", nomeOp((TipoOp)t), est.cpi_cabeca[t] / n);
+        }
+        fprintf(out, ", \"rob_vazio\": %.6f},\n", est.cpi_rob_vazio / n);
+        
+        fprintf(out, "  \"paradas_emissao\": {");
+        for(int p = (int)Parada::FIM_PROGRAMA; p < (int)Parada::NUM_PARADAS; p++) {
+            fprintf(out, "%s\"%s\": %lld", p > (int)Parada::FIM_PROGRAMA ? ", " : "",
+                    NOMES_PARADA[p], est.paradas_emissao[p]);
+        }
+        fprintf(out, "},\n  \"cabeca_bloqueada\": {");
+        for(int t = 0; t < NUM_TIPOS_OP; t++) {
+            fprintf(out, "%s\"%s\": %lld", t > 0 ? ", " : "", nomeOp((TipoOp)t), est.cabeca_bloqueada[t]);
+        }
+        fprintf(out, "},\n");
+        
+        auto unidade = [&](const char* nome, const ContadoresUnidade& c, size_t tamanho) {
+            fprintf(out, "  \"%s\": {\"entradas\": %zu, \"ocupacao\": %lld, \"executando\": %lld, "
+                         "\"espera_operandos\": %lld},\n",
+                    nome, tamanho, c.ocupacao, c.executando, c.espera_operandos);
+        };
+        unidade("rs_soma", est.rs_soma, RS_soma.tamanho());
+        unidade("rs_mul", est.rs_mul, RS_mul.tamanho());
+        unidade("buffer_carga", est.buffer_carga, BufferCarga.tamanho());
+        unidade("buffer_arm", est.buffer_arm, BufferArm.tamanho());
+        fprintf(out, "  \"ocupacao_rob\": %lld,\n", est.ocupacao_rob);
+        fprintf(out, "  \"unidades\": {\"uf_soma\": %d, \"uf_mul\": %d, \"div_iterativo\": %d, "
+                     "\"barramentos_cdb\": %d, \"espera_uf_soma\": %lld, \"espera_uf_mul\": %lld, "
+                     "\"espera_cdb\": %lld, \"transmissoes_cdb\": %lld},\n",
+                cfg.uf_soma, cfg.uf_mul, cfg.div_iterativo, cfg.barramentos_cdb, est.espera_uf_soma,
+                est.espera_uf_mul, est.espera_cdb, est.transmissoes_cdb);
+        auto nivel = [&](const char* nome, const ContadoresCache& c, bool fim) {
+            fprintf(out, "\"%s\": {\"acessos\": %lld, \"faltas\": %lld, \"pendentes\": %lld, \"escritas_volta\": %lld}%s",
+                    nome, c.acessos, c.faltas, c.pendentes, c.escritas_volta, fim ? "" : ", ");
+        };
+        fprintf(out, "  \"cache\": {\"l1_tamanho\": %d, \"l1_assoc\": %d, \"l1_lat\": %d, \"l2_tamanho\": %d, "
+                     "\"l2_assoc\": %d, \"l2_lat\": %d, \"linha\": %d, \"lat_memoria\": %d, \"mshrs\": %d, "
+                     "\"espera_mshr\": %lld, ",
+                cfg.l1_tamanho, cfg.l1_assoc, cfg.l1_lat, cfg.l2_tamanho, cfg.l2_assoc, cfg.l2_lat, cfg.linha_cache,
+                cfg.lat_memoria, cfg.mshrs, est.espera_mshr);
+        nivel("l1", est.cache_l1, false);
+        nivel("l2", est.cache_l2, true);
+        fprintf(out, "},\n");
+        fprintf(out, "  \"renomeacao\": {\"regs_fisicos\": %d, \"fisicos_livres\": %lld, \"bits\": %lld},\n",
+                cfg.regs_fisicos, est.fisicos_livres, bits_renomeacao());
+        if(num_threads() > 1) {
+            fprintf(out, "  \"smt\": {\"rob\": \"%s\", \"politica\": \"%s\", \"threads\": [",
+                    NOMES_ROB_SMT[cfg.rob_smt], NOMES_POLITICA_SMT[cfg.politica_smt]);
+            for(int th = 0; th < num_threads(); th++) {
+                const ContextoThread& c = contextos[th];
+                fprintf(out, "%s{\"emitidas\": %lld, \"consolidadas\": %lld, \"ciclo_fim\": %lld, \"ipc\": %.6f",
+                        th ? ", " : "", c.emitidas, c.consolidadas, c.ciclo_fim, ipc_thread(th));
+                if(!ipc_isolado.empty()) {
+                    fprintf(out, ", \"ipc_isolado\": %.6f, \"ipc_relativo\": %.6f", ipc_isolado[th], ipc_relativo(th));
+                }
+                fprintf(out, "}");
+            }
+            fprintf(out, "]");
+            if(!ipc_isolado.empty()) {
+                double speedup, justica, harmonica;
+                metricas_smt(speedup, justica, harmonica);
+                fprintf(out, ", \"speedup_ponderado\": %.6f, \"justica\": %.6f, \"media_harmonica\": %.6f",
+                        speedup, justica, harmonica);
+            }
+            fprintf(out, "},\n");
+        }
+        fprintf(out, "  \"desvios\": {\"consolidados\": %lld, \"mal_previstos\": %lld, "
+                     "\"descartes\": %lld, \"instrucoes_descartadas\": %lld},\n",
+                est.desvios, est.desvios_mal_previstos, est.descartes, est.instrucoes_descartadas);
+        fprintf(out, "  \"lsq\": {\"cargas_memoria\": %lld, \"encaminhadas\": %lld, \"especulativas\": %lld, "
+                     "\"reexecucoes\": %lld, \"instrucoes_reexecutadas\": %lld},\n",
+                est.cargas_memoria, est.cargas_encaminhadas, est.cargas_especulativas,
+                est.reexecucoes, est.instrucoes_reexecutadas);
+        
+        fprintf(out, "  \"emissao_por_ciclo\": [");
+        for(size_t k = 0; k < est.emissao_por_ciclo.size(); k++) {
+            fprintf(out, "%s%lld", k ? ", " : "", est.emissao_por_ciclo[k]);
+        }
+        fprintf(out, "],\n  \"commit_por_ciclo\": [");
+        for(size_t k = 0; k < est.commit_por_ciclo.size(); k++) {
+            fprintf(out, "%s%lld", k ? ", " : "", est.commit_por_ciclo[k]);
+        }
+        fprintf(out, "]\n}\n");
+    }
+
+    // Parâmetros da máquina gravados no cabeçalho do trace; o decodificador
+    // só aceita traces gerados com a mesma configuração.
+    std::vector<int> parametros_maquina() const {
+        return { REGISTRADORES, PALAVRAS_PAGINA, cfg.rs_soma_count, cfg.rs_mul_count,
+                 cfg.buffer_carga_count, cfg.buffer_arm_count, tam_rob(),
+                 largura_emissao(), largura_commit() };
+    }
+
+    int total_instrucoes() const { return contextos[0].total_instr; }
+
+    // Percorre, em ordem fixa, todos os campos que compõem o estado da
+    // máquina. É a base do trace binário: a ordem define o índice de cada campo.
+    // Trace e checkpoint são só de uma thread (sem SMT).
+    template<class Self, class F>
+    static void visitar_estado(Self& s, F&& f) {
+        auto& c = s.contextos[0];
+        f(c.pc); f(c.total_instr); f(s.particoes[0].cabeca); f(s.particoes[0].cauda);
+        f(s.emitidas_ciclo); f(s.consolidadas_ciclo);
+        // Bits das máscaras são visitados como bool
+        auto bit = [&](auto& mascara, size_t i) {
+            bool b = mascara.testar(i);
+            f(b);
+            if constexpr(!std::is_const_v<Self>) mascara.definir(i, b);
+        };
+        auto visitar_rs = [&](auto& rs) {
+            for(size_t i = 0; i < rs.tamanho(); i++) {
+                bit(rs.ocupada, i); f(rs.op[i]); f(rs.Vj[i]); f(rs.Vk[i]); f(rs.Qj[i]); f(rs.Qk[i]);
+                bit(rs.executando, i); f(rs.ciclosExecRestantes[i]); f(rs.indice_rob[i]);
+            }
+        };
+        auto visitar_buffers = [&](auto& b) {
+            for(size_t i = 0; i < b.tamanho(); i++) {
+                bit(b.ocupada, i); f(b.op[i]); f(b.endereco[i]); f(b.V[i]); f(b.Q[i]);
+                f(b.indice_rob[i]); bit(b.executando, i); f(b.ciclosExecRestantes[i]);
+                bit(b.indireto, i); f(b.Vb[i]); f(b.Qb[i]);
+            }
+        };
+        visitar_rs(s.RS_soma);
+        visitar_rs(s.RS_mul);
+        visitar_buffers(s.BufferCarga);
+        visitar_buffers(s.BufferArm);
+        for(int i = 1; i <= s.tam_rob(); i++) {
+            auto& r = s.ROB[i];
+            f(r.ocupada); f(r.op); f(r.dest); f(r.pronta); f(r.valor);
+            f(r.indice_instr); f(r.endereco_mem); f(r.valor_arm);
+            f(r.endereco_pronto); f(r.fonte_arm);
+        }
+        for(int i = 0; i < REGISTRADORES; i++) { f(c.arquivo_reg.valor[i]); f(c.arquivo_reg.tag[i]); }
+        // A memória não entra: o trace grava as escritas à parte e o
+        // checkpoint, as páginas alocadas
+    }
+
+    void capturar_estado(std::vector<int>& estado) const {
+        estado.clear();
+        visitar_estado(*this, [&](const auto& campo) { estado.push_back((int)campo); });
+    }
+
+    // Usado pelo decodificador: 'textos' são os textos das instruções já
+    // lidas, indexados como EntradaROB::indice_instr
+    void restaurar_estado(const std::vector<int>& estado, const std::vector<std::string>& textos) {
+        size_t i = 0;
+        visitar_estado(*this, [&](auto& campo) {
+            campo = (std::remove_reference_t<decltype(campo)>)estado[i++];
+        });
+        textos_restaurados = &textos;
+    }
+
+    // Estado completo, para checkpoints: o estado do trace mais o que não é
+    // impresso (previsões e histórico dos desvios, valores consolidados,
+    // preditor) e as estatísticas acumuladas. As páginas de memória vão
+    // depois, em salvar_checkpoint().
+    template<class Self, class F>
+    static void visitar_checkpoint(Self& s, F&& f) {
+        visitar_estado(s, f);
+        for(int i = 1; i <= s.tam_rob(); i++) {
+            auto& r = s.ROB[i];
+            f(r.previsto_tomado); f(r.tomado); f(r.indice_preditor); f(r.historico_antes);
+        }
+        auto& c = s.contextos[0];
+        for(auto& v : c.arquivo_reg.consolidado) f(v);
+        f(c.preditor.historico);
+        for(auto& k : c.preditor.contadores) f(k);
+        
+        visitar_estatisticas(f, s.est);
+        
+        // Banco de registradores físicos (vazio sem ele)
+        for(int i = 1; i <= s.tam_rob(); i++) { f(s.ROB[i].fisico); f(s.ROB[i].fisico_anterior); }
+        for(auto& v : s.valor_fisico) f(v);
+        for(auto& v : s.livres) f(v);
+        f(s.n_livres);
+        for(size_t i = 0; i < s.valor_fisico.size(); i++) {
+            bool b = s.pronto_fisico.testar(i);
+            f(b);
+            if constexpr(!std::is_const_v<Self>) s.pronto_fisico.definir(i, b);
+        }
+        HierarquiaCache::visitar(s.cache, f);
+    }
+
+    // Grava o estado completo da máquina no início do ciclo 'ciclo'
+    bool salvar_checkpoint(const std::string& arquivo, int ciclo) const {
+        FluxoCheckpoint fluxo;
+        gravar_config(fluxo, cfg);
+        fluxo.gravar(contextos[0].janela.hash_programa());
+        fluxo.gravar(ciclo);
+        fluxo.gravar(memoria->palavras_imagem());
+        visitar_checkpoint(*this, [&](const auto& campo) { fluxo.gravar(campo); });
+        fluxo.gravar(memoria->paginas_alocadas());
+        memoria->para_cada_pagina([&](uint32_t inicio, const MemoriaPaginada::Pagina& p) {
+            fluxo.gravar(inicio >> BITS_PAGINA);
+            for(int v : p) fluxo.gravar(v);
+        });
+        return fluxo.gravar_arquivo(arquivo);
+    }
+
+    // Restaura um checkpoint gravado por salvar_checkpoint(). O simulador
+    // precisa ter a mesma configuração (ver config_checkpoint()) e já estar
+    // com o mesmo programa carregado; executar() continua do ciclo gravado.
+    bool restaurar_checkpoint(const std::string& arquivo, std::string& erro) {
+        FluxoCheckpoint fluxo;
+        ConfigMaquina c;
+        if(!fluxo.ler_arquivo(arquivo) || !ler_config(fluxo, c)) {
+            erro = "Checkpoint invalido ou ilegivel: " + arquivo;
+            return false;
+        }
+        for(const auto& p : PARAMETROS_MAQUINA) {
+            if(c.*(p.campo) != cfg.*(p.campo)) {
+                erro = "Checkpoint gerado com outra configuracao de maquina";
+                return false;
+            }
+        }
+        uint64_t h = 0;
+        int ciclo = 0;
+        uint32_t palavras_imagem = 0;
+        fluxo.ler(h);
+        fluxo.ler(ciclo);
+        fluxo.ler(palavras_imagem);
+        if(h != 0 && contextos[0].janela.hash_programa() != h) {
+            erro = "Checkpoint gerado com outro programa";
+            return false;
+        }
+        if(palavras_imagem != memoria->palavras_imagem()) {
+            erro = "Checkpoint gerado com outra imagem de memoria (--memoria)";
+            return false;
+        }
+        visitar_checkpoint(*this, [&](auto& campo) { fluxo.ler(campo); });
+        cache.restaurado();
+        size_t paginas = 0;
+        fluxo.ler(paginas);
+        memoria->limpar();
+        for(size_t k = 0; k < paginas && fluxo.ok(); k++) {
+            uint32_t num = 0;
+            fluxo.ler(num);
+            for(int& v : memoria->pagina(num << BITS_PAGINA)) fluxo.ler(v);
+        }
+        if(!fluxo.ok() || !fluxo.no_fim() || ciclo < 1) {
+            erro = "Checkpoint truncado ou corrompido: " + arquivo;
+            return false;
+        }
+        ciclo_inicial = proximo_ciclo = ciclo;
+        // A janela de busca volta a ler a partir do PC restaurado
+        contextos[0].janela.obter(contextos[0].pc);
+        return true;
+    }
+
+    size_t tamanho_estado() const {
+        size_t n = 0;
+        visitar_estado(*this, [&](const auto&) { n++; });
+        return n;
+    }
+
+    // Quantos ciclos seguintes não podem mudar nada além dos contadores de
+    // execução: nenhuma emissão, nenhum início de execução, nenhum término
+    // e nenhum commit. Retorna 0 se o próximo ciclo tem algum evento.
+    int ciclos_ociosos() {
+        if(pode_emitir()) return 0;
+        for(const auto& p : particoes) {
+            if(ROB[p.cabeca].ocupada && ROB[p.cabeca].pronta) return 0;
+        }
+        
+        // Alguma unidade pronta para iniciar a execução neste ciclo (cargas
+        // esperando o valor de um ST em voo não contam)
+        if(!RS_soma.prontas().vazia() || !RS_mul.prontas().vazia() ||
+           !BufferArm.prontas().vazia()) return 0;
+        bool carga = false;
+        BufferCarga.prontas().para_cada([&](size_t i) { carga = carga || carga_pode_iniciar(i); });
+        if(carga) return 0;
+        
+        // Algum ST com endereço a calcular
+        for(size_t i = 0; i < BufferArm.tamanho(); i++) {
+            if(BufferArm.ocupada.testar(i) && BufferArm.Qb[i] == 0 &&
+               !ROB[BufferArm.indice_rob[i]].endereco_pronto) return 0;
+        }
+        
+        int menor = std::min(std::min(RS_soma.menor_restante(), RS_mul.menor_restante()),
+                             std::min(BufferCarga.menor_restante(), BufferArm.menor_restante()));
+        
+        // Nada executando: ou o próximo ciclo tem evento, ou a simulação acabou
+        if(menor <= 1 || menor == INT32_MAX) return 0;
+        // A unidade com menos ciclos restantes termina no ciclo 'menor'
+        return menor - 1;
+    }
+
+    // Avança n ciclos ociosos de uma vez (ver ciclos_ociosos())
+    void saltar_ciclos(int n) {
+        RS_soma.descontar(n);
+        RS_mul.descontar(n);
+        BufferCarga.descontar(n);
+        BufferArm.descontar(n);
+        
+        // Nos ciclos pulados nada muda além dos contadores, então cada
+        // estatística recebe n vezes a contribuição do estado atual
+        emitidas_ciclo = consolidadas_ciclo = 0;
+        est.emissao_por_ciclo[0] += n;
+        est.commit_por_ciclo[0] += n;
+        est.paradas_emissao[(int)verificar_emissao()] += n;
+        contar_ocupacao(RS_soma, est.rs_soma, n);
+        contar_ocupacao(RS_mul, est.rs_mul, n);
+        contar_ocupacao(BufferCarga, est.buffer_carga, n);
+        contar_ocupacao(BufferArm, est.buffer_arm, n);
+        est.ocupacao_rob += (long long)n * ocupadas_rob();
+        est.fisicos_livres += (long long)n * n_livres;
+        int cabeca = cabeca_principal();
+        if(ROB[cabeca].ocupada) est.cabeca_bloqueada[(int)ROB[cabeca].op] += n;
+        contabilizar_cpi(0, n);
+        if(num_threads() > 1) rodizio = (int)((rodizio + n) % num_threads());
+    }
+
+    bool finalizado() {
+        for(auto& c : contextos) {
+            if(c.janela.obter(c.pc)) return false;
+        }
+        
+        if(!RS_soma.ocupada.vazia() || !RS_mul.ocupada.vazia()) return false;
+        if(!BufferCarga.ocupada.vazia() || !BufferArm.ocupada.vazia()) return false;
+        
+        // ROB vazio: cabeça alcançou a cauda
+        return rob_vazio();
+    }
+
+    // Com dirigido_eventos, os ciclos em que só os contadores de execução
+    // andam são pulados de uma vez; o resultado final é o mesmo do modo
+    // ciclo a ciclo, mas esses ciclos não são impressos.
+    void imprimir_cabecalho(bool dirigido_eventos) const {
+        printf("====== SIMULADOR TOMASULO ======\n");
+        for(const auto& c : contextos) {
+            if(c.total_instr >= 0) printf("Carregadas %d instrucoes.\n", c.total_instr);
+            else printf("Programa lido sob demanda (janela de busca).\n");
+        }
+        if(num_threads() > 1) {
+            printf("SMT: %d threads, ROB %s, emissao por %s\n", num_threads(), NOMES_ROB_SMT[cfg.rob_smt],
+                   NOMES_POLITICA_SMT[cfg.politica_smt]);
+        }
+        printf("LD Rd, imm carrega o imediato; LD Rd, desl(Rb) le a memoria (LSQ)\n");
+        if(dirigido_eventos) printf("Modo dirigido a eventos (ciclos ociosos sao pulados)\n");
+        printf("================================\n\n");
+    }
+
+    // Repassa ao trace os textos das instruções lidas desde o último registro
+    void registrar_trace(GravadorTrace& trace, int ciclo, std::vector<int>& estado, int& textos_gravados) {
+        const JanelaBusca& janela = contextos[0].janela;
+        for(; textos_gravados < janela.lidas(); textos_gravados++) {
+            trace.adicionar_texto(janela.texto(textos_gravados));
+        }
+        capturar_estado(estado);
+        trace.registrar(ciclo, estado, memoria->escritas);
+        memoria->escritas.clear();
+    }
+
+    // Passa a registrar as escritas na memória para o trace; o primeiro
+    // registro leva o conteúdo já existente (execução retomada ou imagem)
+    void iniciar_trace_memoria() {
+        memoria->registrar_escritas = true;
+        memoria->escritas.reserve(largura_commit());
+        memoria->para_cada_pagina([&](uint32_t inicio, const MemoriaPaginada::Pagina& p) {
+            for(int i = 0; i < PALAVRAS_PAGINA; i++) {
+                if(p[i] != 0) memoria->escritas.emplace_back(inicio + i, p[i]);
+            }
+        });
+    }
+
+    // Liga a linha do tempo; as instruções já no ROB (execução retomada de um
+    // checkpoint) entram como emitidas agora, sem a unidade
+    void iniciar_linha_tempo(GravadorLinhaTempo& lt, int ciclo) {
+        linha_tempo = &lt;
+        for(const auto& p : particoes) {
+            for(int t = p.cabeca; t != p.cauda; t = proxima_rob(p, t)) {
+                const EntradaROB& r = ROB[t];
+                if(r.ocupada) lt.emitida(ciclo, t, r.indice_instr, texto_instr(r.thread, r.indice_instr),
+                                         Unidade::NENHUMA, 0, r.thread);
+            }
+        }
+    }
+
+    // Usado pelo decodificador do trace
+    void escrever_memoria(uint32_t endereco, int valor) { memoria->escrever(endereco, valor); }
+
+    void definir_imagem_memoria(std::shared_ptr<const ImagemMemoria> img) { memoria->definir_imagem(std::move(img)); }
+
+    // Multinúcleo: passa a usar a memória compartilhada, com as escritas
+    // consolidadas guardadas em 'pendentes' até o fim do quantum
+    void compartilhar_memoria(MemoriaPaginada& compartilhada, BufferEscritas& pendentes) {
+        memoria = &compartilhada;
+        escritas_pendentes = &pendentes;
+        pendentes.dimensionar((size_t)largura_commit() * QUANTUM_MAXIMO);
+    }
+
+    // Multinúcleo: simula até o ciclo 'limite' (inclusive) ou até o fim do
+    // programa. Ciclos ociosos pulados não passam do limite, onde a memória
+    // compartilhada pode mudar.
+    void executar_quantum(int limite, bool dirigido_eventos) {
+        while(!finalizado() && proximo_ciclo <= limite) {
+            if(dirigido_eventos) {
+                int ociosos = std::min(ciclos_ociosos(), limite + 1 - proximo_ciclo);
+                if(ociosos > 0) {
+                    saltar_ciclos(ociosos);
+                    proximo_ciclo += ociosos;
+                    continue;
+                }
+            }
+            executar_ciclo(proximo_ciclo++);
+        }
+        if(finalizado()) est.ciclos = proximo_ciclo - 1;
+    }
+
+    // Biblioteca: simula até n ciclos, parando antes no fim do programa ou
+    // num ponto de parada (ver PontoParada)
+    ResultadoPasso passo(long long n = 1) {
+        return avancar(n, [](const SimuladorTomasulo&) { return false; });
+    }
+
+    // Simula até o fim do programa ou um ponto de parada
+    ResultadoPasso continuar() { return passo(INT64_MAX); }
+
+    // Como continuar(), parando também depois do primeiro ciclo em que
+    // pred(*this) for verdadeiro
+    template<class Pred>
+    ResultadoPasso executar_ate(Pred&& pred) { return avancar(INT64_MAX, pred); }
+
+    // Com pular = true, passo() e afins pulam ciclos ociosos de uma vez (ver
+    // ciclos_ociosos()); nesses ciclos nenhum ponto de parada, exceto os de
+    // CICLO, pode disparar, e o predicado de executar_ate() não é avaliado
+    void definir_dirigido_eventos(bool pular) { pular_ociosos = pular; }
+
+    // Retorna o id do novo ponto. Vigias guardam o valor atual como base.
+    int adicionar_ponto(TipoPontoParada tipo, int valor, int thread = -1) {
+        PontoParada p;
+        p.id = proximo_ponto++;
+        p.tipo = tipo;
+        p.valor = valor;
+        p.thread = thread;
+        p.anterior = valor_vigiado(p);
+        pontos.push_back(p);
+        return p.id;
+    }
+
+    bool remover_ponto(int id) {
+        for(size_t i = 0; i < pontos.size(); i++) {
+            if(pontos[i].id == id) {
+                pontos.erase(pontos.begin() + i);
+                return true;
+            }
+        }
+        return false;
+    }
+
+    const std::vector<PontoParada>& pontos_parada() const { return pontos; }
+
+    // Visões do estado, sem formatação
+    int ciclo() const { return proximo_ciclo - 1; }
+    int pc(int th = 0) const { return contextos[th].pc; }
+    const BancoRegistradores& registradores(int th = 0) const { return contextos[th].arquivo_reg; }
+    const EntradaROB& rob(int tag) const { return ROB[tag]; }
+    // Resultado da entrada: o do ROB ou, com o banco físico, o do registrador
+    // físico de destino
+    int resultado_rob(int tag) const { return ROB[tag].fisico ? valor_fisico[ROB[tag].fisico] : ROB[tag].valor; }
+    int cabeca_rob(int th = 0) const { return particao(th).cabeca; }
+    int cauda_rob(int th = 0) const { return particao(th).cauda; }
+    int palavra_memoria(uint32_t endereco) const { return ler_memoria((int)endereco); }
+
+    int estacoes(Unidade u) const {
+        switch(u) {
+            case Unidade::RS_SOMA: return (int)RS_soma.tamanho();
+            case Unidade::RS_MUL: return (int)RS_mul.tamanho();
+            case Unidade::CARGA: return (int)BufferCarga.tamanho();
+            case Unidade::ARM: return (int)BufferArm.tamanho();
+            default: return 0;
+        }
+    }
+
+    VisaoEstacao estacao(Unidade u, int i) const {
+        VisaoEstacao v;
+        auto comum = [&](const auto& banco) {
+            v.ocupada = banco.ocupada.testar(i);
+            v.executando = banco.executando.testar(i);
+            v.op = banco.op[i];
+            v.restante = banco.ciclosExecRestantes[i];
+            v.rob = banco.indice_rob[i];
+        };
+        auto rs = [&](const auto& banco) {
+            comum(banco);
+            v.Vj = banco.Vj[i]; v.Vk = banco.Vk[i];
+            v.Qj = banco.Qj[i]; v.Qk = banco.Qk[i];
+        };
+        auto buffer = [&](const auto& banco) {
+            comum(banco);
+            v.Vj = banco.V[i]; v.Qj = banco.Q[i];
+            v.Vk = banco.Vb[i]; v.Qk = banco.Qb[i];
+            v.endereco = banco.endereco[i];
+        };
+        switch(u) {
+            case Unidade::RS_SOMA: rs(RS_soma); break;
+            case Unidade::RS_MUL: rs(RS_mul); break;
+            case Unidade::CARGA: buffer(BufferCarga); break;
+            case Unidade::ARM: buffer(BufferArm); break;
+            default: break;
+        }
+        return v;
+    }
+
+private:
+    int valor_vigiado(const PontoParada& p) const {
+        if(p.tipo == TipoPontoParada::REGISTRADOR) {
+            return contextos[std::max(p.thread, 0)].arquivo_reg.consolidado[p.valor];
+        }
+        return p.tipo == TipoPontoParada::MEMORIA ? ler_memoria(p.valor) : 0;
+    }
+
+    void verificar_commit(const EntradaROB& r) {
+        for(const auto& p : pontos) {
+            if(p.tipo == TipoPontoParada::COMMIT && p.valor == r.indice_instr &&
+               (p.thread < 0 || p.thread == r.thread) && commit_disparado == 0) {
+                commit_disparado = p.id;
+            }
+        }
+    }
+
+    // Id do primeiro ponto disparado pelo ciclo que acabou de ser simulado
+    // ('pcs' são os PCs de busca antes dele), ou 0
+    int verificar_pontos(const std::array<int, MAX_THREADS_SMT>& pcs) {
+        int disparado = commit_disparado;
+        commit_disparado = 0;
+        for(auto& p : pontos) {
+            switch(p.tipo) {
+                case TipoPontoParada::PC:
+                    for(int th = 0; th < num_threads(); th++) {
+                        if((p.thread < 0 || p.thread == th) && contextos[th].pc == p.valor && pcs[th] != p.valor) {
+                            disparado = disparado ? disparado : p.id;
+                        }
+                    }
+                    break;
+                case TipoPontoParada::REGISTRADOR:
+                case TipoPontoParada::MEMORIA: {
+                    int v = valor_vigiado(p);
+                    if(v != p.anterior) disparado = disparado ? disparado : p.id;
+                    p.anterior = v;
+                    break;
+                }
+                default: break;
+            }
+        }
+        return disparado;
+    }
+
+    // Próximo ciclo com ponto de parada de CICLO depois de 'ciclo'
+    int proximo_ciclo_parada(int ciclo) const {
+        int menor = INT32_MAX;
+        for(const auto& p : pontos) {
+            if(p.tipo == TipoPontoParada::CICLO && p.valor > ciclo) menor = std::min(menor, p.valor);
+        }
+        return menor;
+    }
+
+    // Laço de passo() e executar_ate(). O ponto de CICLO em que a execução
+    // parou não dispara de novo ao retomar.
+    template<class Pred>
+    ResultadoPasso avancar(long long n, Pred&& pred) {
+        ResultadoPasso parada;
+        std::array<int, MAX_THREADS_SMT> pcs{};
+        long long feitos = 0;
+        while(true) {
+            if(finalizado()) {
+                parada.motivo = MotivoParada::FIM;
+                break;
+            }
+            if(feitos >= n) {
+                parada.motivo = MotivoParada::PASSOS;
+                break;
+            }
+            int alvo = proximo_ciclo_parada(feitos > 0 ? proximo_ciclo - 1 : proximo_ciclo);
+            if(alvo == proximo_ciclo && feitos > 0) {
+                parada.motivo = MotivoParada::PONTO_PARADA;
+                for(const auto& p : pontos) {
+                    if(p.tipo == TipoPontoParada::CICLO && p.valor == alvo) parada.ponto = p.id;
+                }
+                break;
+            }
+            if(pular_ociosos) {
+                long long ociosos = std::min<long long>(ciclos_ociosos(), n - feitos);
+                if(alvo != INT32_MAX) ociosos = std::min<long long>(ociosos, alvo - proximo_ciclo);
+                if(ociosos > 0) {
+                    saltar_ciclos((int)ociosos);
+                    proximo_ciclo += (int)ociosos;
+                    feitos += ociosos;
+                    continue;
+                }
+            }
+            for(int th = 0; th < num_threads(); th++) pcs[th] = contextos[th].pc;
+            executar_ciclo(proximo_ciclo++);
+            feitos++;
+            if(!pontos.empty() && (parada.ponto = verificar_pontos(pcs)) != 0) {
+                parada.motivo = MotivoParada::PONTO_PARADA;
+                break;
+            }
+            if(pred(*this)) {
+                parada.motivo = MotivoParada::PREDICADO;
+                break;
+            }
+        }
+        est.ciclos = parada.ciclo = proximo_ciclo - 1;
+        return parada;
+    }
+
+public:
+    // Estágios do algoritmo de Tomasulo
+    void executar_ciclo(int ciclo) {
+        ciclo_atual = ciclo;
+        emitir();
+        tentar_iniciar_rs(RS_soma);
+        tentar_iniciar_rs(RS_mul);
+        tentar_iniciar_cargas();
+        tentar_iniciar_arms();
+        avancar_execucao_e_escrever(ciclo);
+        consolidar();
+    }
+
+    void executar_ciclo_medido(int ciclo, TemposEstagio& tempos) {
+        using relogio = std::chrono::steady_clock;
+        auto ns = [](relogio::time_point a, relogio::time_point b) {
+            return std::chrono::duration<double, std::nano>(b - a).count();
+        };
+        ciclo_atual = ciclo;
+        auto t0 = relogio::now();
+        emitir();
+        auto t1 = relogio::now();
+        tentar_iniciar_rs(RS_soma);
+        tentar_iniciar_rs(RS_mul);
+        tentar_iniciar_cargas();
+        tentar_iniciar_arms();
+        auto t2 = relogio::now();
+        avancar_execucao_e_escrever(ciclo);
+        auto t3 = relogio::now();
+        consolidar();
+        auto t4 = relogio::now();
+        tempos.emitir += ns(t0, t1);
+        tempos.iniciar += ns(t1, t2);
+        tempos.avancar += ns(t2, t3);
+        tempos.consolidar += ns(t3, t4);
+        tempos.ciclos++;
+    }
+
+    // Modo funcional: a cache acompanha os acessos, sem tempo nem estatísticas
+    void aquecer_cache(int endereco, bool escrita) {
+        if(!cache.ativa()) return;
+        cache.acessar((uint32_t)endereco, escrita, 0, funcional_l1, funcional_l2, false);
+    }
+
+    // Executa até n instruções a partir de pc sem modelar o pipeline (que
+    // precisa estar vazio), parando antes se o PC sair de [inicio, fim]:
+    // atualiza registradores, memória, o preditor e a cache. Retorna quantas
+    // foram executadas.
+    long long avancar_funcional(long long n, int inicio = 0, int fim = INT32_MAX) {
+        ContextoThread& c = contextos[0];
+        JanelaBusca& janela = c.janela;
+        BancoRegistradores& arquivo_reg = c.arquivo_reg;
+        PreditorDesvios& preditor = c.preditor;
+        int& pc = c.pc;
+        long long feitas = 0;
+        const Instr* ins;
+        for(; feitas < n && pc >= inicio && pc <= fim && (ins = janela.obter(pc)) != nullptr; feitas++) {
+            int* r = arquivo_reg.consolidado.data();
+            int proximo = pc + 1;
+            int res = 0;
+            // Para antes do acesso que passaria do limite de faltas
+            if(limite_faltas_funcional >= 0 && funcional_l1.faltas >= limite_faltas_funcional &&
+               ((ins->tipo == TipoOp::LD && ins->src2 != SEM_BASE) || ins->tipo == TipoOp::ST) &&
+               !cache.presente((uint32_t)(ins->imm + (ins->src2 == SEM_BASE ? 0 : r[ins->src2])))) break;
+            switch(ins->tipo) {
+                case TipoOp::ADD: res = r[ins->src1] + r[ins->src2]; break;
+                case TipoOp::SUB: res = r[ins->src1] - r[ins->src2]; break;
+                case TipoOp::MUL: res = r[ins->src1] * r[ins->src2]; break;
+                case TipoOp::DIV: res = r[ins->src2] != 0 ? r[ins->src1] / r[ins->src2] : 0; break;
+                case TipoOp::LD:
+                    if(ins->src2 == SEM_BASE) res = ins->imm;
+                    else {
+                        res = ler_memoria(r[ins->src2] + ins->imm);
+                        aquecer_cache(r[ins->src2] + ins->imm, false);
+                    }
+                    break;
+                case TipoOp::ST: {
+                    int endereco = ins->imm + (ins->src2 == SEM_BASE ? 0 : r[ins->src2]);
+                    gravar_memoria(endereco, r[ins->src1]);
+                    aquecer_cache(endereco, true);
+                    break;
+                }
+                case TipoOp::BEQ:
+                case TipoOp::BNE: {
+                    bool tomado = (r[ins->src1] == r[ins->src2]) == (ins->tipo == TipoOp::BEQ);
+                    preditor.treinar(preditor.indice(pc), tomado);
+                    preditor.registrar(preditor.historico, tomado);
+                    if(tomado) proximo = ins->imm;
+                    break;
+                }
+                case TipoOp::J: proximo = ins->imm; break;
+                default: break;
+            }
+            if(escreve_registrador(ins->tipo)) {
+                r[ins->dest] = res;
+                arquivo_reg.valor[ins->dest] = res;
+                if(usa_fisicos()) valor_fisico[arquivo_reg.tag[ins->dest]] = res;
+            }
+            pc = proximo;
+            janela.liberar_ate(pc);
+        }
+        c.total_instr = janela.total();
+        return feitas;
+    }
+
+    // Simulação por amostragem (ver ParametrosAmostragem). Só o estado final
+    // é impresso; os ciclos e estatísticas são os do modelo detalhado e o
+    // total de ciclos do programa é estimado no fim.
+    long long executar_amostrado(const ParametrosAmostragem& a, const OpcoesExecucao& opcoes) {
+        amostragem = ResultadoAmostragem();
+        amostragem.ativa = true;
+        if(opcoes.verbosidade != Verbosidade::NENHUMA) {
+            imprimir_cabecalho(opcoes.dirigido_eventos);
+            printf("Amostragem: intervalo %lld, aquecimento %lld, janela %lld instrucoes\n\n",
+                   a.intervalo, a.aquecimento, a.janela);
+        }
+        
+        long long ciclo = 1;
+        while(true) {
+            amostragem.instrucoes_funcionais += avancar_funcional(a.intervalo - a.aquecimento - a.janela);
+            if(!contextos[0].janela.obter(contextos[0].pc)) break;
+            
+            // Aquecimento e janela no modelo detalhado, depois esvaziamento
+            long long inicio = est.consolidadas;
+            long long ciclo_janela = -1, inicio_janela = 0;
+            drenando = false;
+            while(!finalizado()) {
+                if(ciclo_janela < 0 && est.consolidadas - inicio >= a.aquecimento) {
+                    ciclo_janela = ciclo;
+                    inicio_janela = est.consolidadas;
+                }
+                if(ciclo_janela >= 0 && !drenando && est.consolidadas - inicio_janela >= a.janela) {
+                    amostragem.cpi.push_back((double)(ciclo - ciclo_janela) / (est.consolidadas - inicio_janela));
+                    drenando = true;
+                }
+                if(drenando && rob_vazio()) break;
+                
+                if(opcoes.dirigido_eventos) {
+                    int ociosos = ciclos_ociosos();
+                    if(ociosos > 0) {
+                        saltar_ciclos(ociosos);
+                        ciclo += ociosos;
+                    }
+                }
+                executar_ciclo((int)ciclo);
+                ciclo++;
+            }
+            // Fim do programa no meio da janela: vale se mediu ao menos metade
+            if(!drenando && ciclo_janela >= 0 && est.consolidadas - inicio_janela >= std::max(1LL, a.janela / 2)) {
+                amostragem.cpi.push_back((double)(ciclo - ciclo_janela) / (est.consolidadas - inicio_janela));
+            }
+            drenando = false;
+            amostragem.instrucoes_detalhadas += est.consolidadas - inicio;
+        }
+        
+        est.ciclos = ciclo - 1;
+        if(opcoes.verbosidade == Verbosidade::COMPLETA) imprimir_estado((int)ciclo);
+        if(opcoes.verbosidade != Verbosidade::NENHUMA) {
+            printf("\n====== EXECUCAO FINALIZADA: %lld ciclos detalhados ======\n", ciclo - 1);
+            imprimir_estatisticas();
+        }
+        return ciclo - 1;
+    }
+
+    const ResultadoAmostragem& resultado_amostragem() const { return amostragem; }
+
+    /* Assinatura do estado que decide o tempo das próximas iterações de um
+       laço [alvo, fim], relativo à cabeça do ROB: PC de busca, ocupação do
+       ROB (instrução e progresso de cada entrada), estações e buffers
+       ocupados (posição no ROB, ciclos restantes e de quem esperam cada
+       operando), lista livre, os contadores do preditor usados pelo laço e,
+       com cache, o conteúdo dela (tags e ordem LRU) e as faltas em
+       andamento. Valores de dados ficam de fora. */
+    uint64_t assinatura_temporal(int alvo, int fim) {
+        const ParticaoROB& p = particoes[0];
+        const ContextoThread& c = contextos[0];
+        uint64_t h = 0xcbf29ce484222325ULL;
+        auto misturar = [](uint64_t& x, long long v) { x = (x ^ (uint64_t)v) * 0x100000001b3ULL; };
+        misturar(h, c.pc);
+        misturar(h, emitidas_ciclo);
+        misturar(h, consolidadas_ciclo);
+        misturar(h, n_livres);
+        int k = 0;
+        for(int t = p.cabeca; t != p.cauda; t = proxima_rob(p, t), k++) {
+            const EntradaROB& r = ROB[t];
+            misturar(h, r.ocupada);
+            misturar(h, (int)r.op);
+            misturar(h, r.indice_instr);
+            misturar(h, r.pronta);
+            misturar(h, r.endereco_pronto);
+            misturar(h, r.fonte_arm ? posicao_rob(p, r.fonte_arm) + 1 : 0);
+            if(usa_fisicos() && r.ocupada && r.fisico) laco.posicao_fisico[r.fisico] = k + 1;
+        }
+        // Produtor de um operando pendente, pela posição no ROB
+        auto produtor = [&](int q) {
+            if(q == 0) return 0;
+            return usa_fisicos() ? laco.posicao_fisico[q] : posicao_rob(p, q) + 1;
+        };
+        // Os slots não importam, só o conjunto de entradas: soma comutativa
+        uint64_t soma = 0;
+        auto banco = [&](const auto& b, int id, auto&& operandos) {
+            b.ocupada.para_cada([&](size_t i) {
+                uint64_t g = 0xcbf29ce484222325ULL;
+                misturar(g, id);
+                misturar(g, posicao_rob(p, b.indice_rob[i]));
+                misturar(g, b.executando.testar(i) ? b.ciclosExecRestantes[i] + 1 : 0);
+                operandos(g, i);
+                soma += g;
+            });
+        };
+        auto rs = [&](const auto& b) {
+            return [&](uint64_t& g, size_t i) { misturar(g, produtor(b.Qj[i])); misturar(g, produtor(b.Qk[i])); };
+        };
+        auto buffer = [&](const auto& b) {
+            return [&](uint64_t& g, size_t i) {
+                misturar(g, produtor(b.Q[i]));
+                misturar(g, produtor(b.Qb[i]));
+                misturar(g, b.indireto.testar(i));
+            };
+        };
+        banco(RS_soma, 1, rs(RS_soma));
+        banco(RS_mul, 2, rs(RS_mul));
+        banco(BufferCarga, 3, buffer(BufferCarga));
+        banco(BufferArm, 4, buffer(BufferArm));
+        misturar(h, (long long)soma);
+        if(cache.ativa()) {
+            misturar(h, (long long)cache.l1.assinatura);
+            misturar(h, (long long)cache.l2.assinatura);
+            for(int fim_mshr : cache.fim_mshr) misturar(h, std::max(0, fim_mshr - ciclo_atual));
+            misturar(h, std::max(0, cache.ultima_chegada - ciclo_atual));
+        }
+        
+        const PreditorDesvios& d = c.preditor;
+        misturar(h, d.historico);
+        if(!d.contadores.empty()) {
+            for(int pc = alvo; pc <= fim; pc++) misturar(h, d.contadores[d.indice(pc)]);
+        }
+        return h;
+    }
+
+    /* Fim do ciclo em que um desvio para trás foi consolidado (fronteira de
+       iteração do laço desse desvio): procura o menor período p, em
+       iterações, tal que as últimas laco.exigidas * p iterações repetem as
+       p anteriores, com a mesma assinatura, a mesma duração e as mesmas
+       faltas em cada nível da cache. Como a assinatura inclui o conteúdo da
+       cache, um laço que ainda traz linhas novas (percorre um vetor, ou
+       enche a cache) não repete e fica no modelo detalhado. Achado, o laço
+       está em regime permanente; quando está nele há tempo suficiente (ver
+       GANHO_MINIMO_LACO), o pipeline é esvaziado para extrapolá-lo (ver
+       extrapolar_laco()). */
+    void verificar_fronteira(int ciclo) {
+        DetectorLaco& d = laco;
+        d.pendente = false;
+        LacoMonitorado* l = &d.lacos[0];
+        for(auto& x : d.lacos) {
+            if(x.pc == d.pc_pendente) { l = &x; break; }
+            if(x.uso < l->uso) l = &x;
+        }
+        if(l->pc != d.pc_pendente) {
+            l->pc = d.pc_pendente;
+            l->alvo = d.alvo_pendente;
+            l->n = 0;
+            l->curto = false;
+        }
+        l->uso = ++d.relogio;
+        if(l->curto) return;
+        long long n = l->n++;
+        if(n == 0) l->inicio_regime = ciclo;
+        FronteiraLaco& f = l->fronteira(n);
+        f.assinatura = assinatura_temporal(l->alvo, l->pc);
+        f.ciclo = ciclo;
+        f.instrucoes = est.consolidadas;
+        f.faltas_l1 = est.cache_l1.faltas;
+        f.faltas_l2 = est.cache_l2.faltas;
+        l->est_fronteira(n) = est;      // mesmos tamanhos: não aloca
+        
+        for(int p = 1; p <= PERIODO_MAXIMO_LACO && n >= (long long)(d.exigidas + 1) * p; p++) {
+            bool igual = true;
+            for(long long k = n; igual && k > n - (long long)d.exigidas * p; k--) {
+                const FronteiraLaco& a = l->fronteira(k);
+                const FronteiraLaco& a0 = l->fronteira(k - 1);
+                const FronteiraLaco& b = l->fronteira(k - p);
+                const FronteiraLaco& b0 = l->fronteira(k - p - 1);
+                igual = a.assinatura == b.assinatura && a.ciclo - a0.ciclo == b.ciclo - b0.ciclo &&
+                        a.instrucoes - a0.instrucoes == b.instrucoes - b0.instrucoes &&
+                        a.faltas_l1 - a0.faltas_l1 == b.faltas_l1 - b0.faltas_l1 &&
+                        a.faltas_l2 - a0.faltas_l2 == b.faltas_l2 - b0.faltas_l2;
+            }
+            if(igual) {
+                // Esvaziar leva ~ a ocupação do ROB no ritmo do laço
+                const FronteiraLaco& f0 = l->fronteira(n - p);
+                long long esvaziar = std::max(1LL, (long long)(f.ciclo - f0.ciclo) * ocupadas_rob() /
+                                                   std::max(1LL, f.instrucoes - f0.instrucoes));
+                if(ciclo - l->inicio_regime < GANHO_MINIMO_LACO * esvaziar) return;
+                d.detectado = l;
+                d.periodo = p;
+                drenando = true;
+                return;
+            }
+        }
+        l->inicio_regime = ciclo;
+    }
+
+    /* Com o pipeline vazio depois da detecção: executa funcionalmente o
+       resto do laço (até o PC sair do corpo) e atribui às instruções desde
+       a última fronteira, as do esvaziamento inclusive, o tempo e as
+       estatísticas do último período, proporcionalmente. Com cache, o modo
+       funcional anda um período (em instruções) por vez e para no primeiro
+       com faltas diferentes das do período medido, antes do acesso que
+       passaria delas: um laço que percorre um vetor passa muitas iterações
+       sem faltar entre uma linha e a seguinte, e elas não valem pelo resto.
+       A falta fica para o modelo detalhado, que continua dali. Retorna o
+       ciclo em que a simulação detalhada continua. */
+    int extrapolar_laco(int ciclo, bool completo) {
+        LacoMonitorado& l = *laco.detectado;
+        int periodo = laco.periodo;
+        ContextoThread& c = contextos[0];
+        long long n = l.n - 1;
+        const FronteiraLaco& f = l.fronteira(n);
+        const FronteiraLaco& f0 = l.fronteira(n - periodo);
+        long long funcionais = 0;
+        if(!cache.ativa()) funcionais = avancar_funcional(INT64_MAX, l.alvo, l.pc);
+        else {
+            long long por_periodo = f.instrucoes - f0.instrucoes;
+            limite_faltas_funcional = f.faltas_l1 - f0.faltas_l1;
+            for(;;) {
+                funcional_l1 = funcional_l2 = ContadoresCache();
+                long long k = avancar_funcional(por_periodo, l.alvo, l.pc);
+                funcionais += k;
+                if(k < por_periodo || funcional_l1.faltas != f.faltas_l1 - f0.faltas_l1 ||
+                   funcional_l2.faltas != f.faltas_l2 - f0.faltas_l2) break;
+            }
+            limite_faltas_funcional = -1;
+            cache.concluir_faltas();
+        }
+        long long instrucoes = est.consolidadas - f.instrucoes + funcionais;
+        double m = (double)instrucoes / (f.instrucoes - f0.instrucoes);
+        visitar_estatisticas([&](auto& e, const auto& a, const auto& b) {
+            if constexpr(std::is_floating_point_v<std::remove_reference_t<decltype(e)>>) e = b + m * (b - a);
+            else e = b + llround(m * (b - a));
+        }, est, l.est_fronteira(n - periodo), l.est_fronteira(n));
+        int proximo = f.ciclo + 1 + (int)llround(m * (f.ciclo - f0.ciclo));
+        c.emitidas += funcionais;
+        c.consolidadas += funcionais;
+        c.ciclo_fim = proximo - 1;
+        
+        double iteracoes = m * periodo;
+        extrapolacao.lacos++;
+        extrapolacao.iteracoes += iteracoes;
+        extrapolacao.instrucoes += instrucoes;
+        extrapolacao.instrucoes_funcionais += funcionais;
+        extrapolacao.ciclos += proximo - 1 - f.ciclo;
+        if(completo) {
+            printf("... laco [%d, %d] extrapolado: %.1f iteracoes, %lld instrucoes (%lld funcionais), "
+                   "ciclos %d a %d (esvaziado no ciclo %d)\n", l.alvo, l.pc, iteracoes, instrucoes,
+                   funcionais, f.ciclo + 1, proximo - 1, ciclo - 1);
+        }
+        // A próxima execução do laço (num laço externo) recomeça a detecção
+        l.n = 0;
+        l.curto = proximo - 1 - f.ciclo < (long long)GANHO_MINIMO_LACO * (ciclo - 1 - f.ciclo);
+        laco.detectado = nullptr;
+        drenando = false;
+        return proximo;
+    }
+
+    const ResultadoExtrapolacao& resultado_extrapolacao() const { return extrapolacao; }
+
+    // Checkpoint pedido em OpcoesExecucao que não foi gravado na última
+    // executar() (falha na escrita, ou o programa acabou antes do ciclo), ou
+    // "" se foi gravado ou não havia pedido. Quem chama decide se reporta.
+    const std::string& erro_checkpoint() const { return erro_ckp; }
+
+    void gravar_checkpoint(const OpcoesExecucao& opcoes, int ciclo) {
+        if(!salvar_checkpoint(opcoes.arquivo_checkpoint, ciclo)) {
+            erro_ckp = "Erro ao gravar checkpoint: " + opcoes.arquivo_checkpoint;
+        }
+    }
+
+    int executar(const OpcoesExecucao& opcoes = OpcoesExecucao()) {
+        int ciclo = ciclo_inicial;
+        bool completo = opcoes.verbosidade == Verbosidade::COMPLETA;
+        std::vector<int> estado;
+        estado.reserve(tamanho_estado());
+        int textos_gravados = 0;
+        erro_ckp.clear();
+        
+        if(opcoes.verbosidade != Verbosidade::NENHUMA) {
+            imprimir_cabecalho(opcoes.dirigido_eventos);
+            if(ciclo > 1) printf("Retomado de checkpoint no ciclo %d\n\n", ciclo);
+        }
+        
+        if(opcoes.trace) iniciar_trace_memoria();
+        if(opcoes.linha_tempo) iniciar_linha_tempo(*opcoes.linha_tempo, ciclo);
+        // Extrapolação de laços: só com uma thread; as cópias das
+        // estatísticas são alocadas aqui, fora do laço
+        laco = DetectorLaco();
+        if(opcoes.extrapolar_lacos > 0 && num_threads() == 1) {
+            extrapolacao = ResultadoExtrapolacao();
+            extrapolacao.ativa = true;
+            laco.exigidas = opcoes.extrapolar_lacos;
+            for(auto& l : laco.lacos) {
+                l.fronteiras.resize((size_t)(laco.exigidas + 1) * PERIODO_MAXIMO_LACO + 1);
+                for(auto& e : l.est) e = est;
+            }
+            laco.posicao_fisico.assign(valor_fisico.size(), 0);
+        }
+        
+        // Loop principal de execução ciclo a ciclo. Páginas de memória são
+        // alocadas por endereço tocado, não por ciclo, e não contam.
+        size_t alocacoes_antes = alocacoes_heap.load(std::memory_order_relaxed);
+        size_t alocacoes_memoria = memoria->alocacoes_feitas();
+        while(!finalizado()) {
+            if(laco.detectado && rob_vazio()) {
+                ciclo = extrapolar_laco(ciclo, completo);
+                continue;
+            }
+            if(opcoes.dirigido_eventos) {
+                int ociosos = ciclos_ociosos();
+                // O ciclo do checkpoint não é pulado
+                if(ciclo < opcoes.ciclo_checkpoint) ociosos = std::min(ociosos, opcoes.ciclo_checkpoint - ciclo);
+                if(ociosos > 0) {
+                    saltar_ciclos(ociosos);
+                    if(completo) printf("... %d ciclos ociosos pulados (%d a %d)\n",
+                                        ociosos, ciclo, ciclo + ociosos - 1);
+                    ciclo += ociosos;
+                }
+            }
+            
+            if(ciclo == opcoes.ciclo_checkpoint) {
+                // Gravar o checkpoint aloca; isso não conta para o laço
+                size_t antes = alocacoes_heap.load(std::memory_order_relaxed);
+                gravar_checkpoint(opcoes, ciclo);
+                alocacoes_antes += alocacoes_heap.load(std::memory_order_relaxed) - antes;
+            }
+            
+            if(completo) imprimir_estado(ciclo);
+            if(opcoes.trace) registrar_trace(*opcoes.trace, ciclo, estado, textos_gravados);
+            
+            if(opcoes.tempos) executar_ciclo_medido(ciclo, *opcoes.tempos);
+            else executar_ciclo(ciclo);
+            if(laco.pendente) verificar_fronteira(ciclo);
+            
+            ciclo++;
+        }
+        // O programa pode terminar enquanto o laço detectado é esvaziado
+        drenando = false;
+        laco.detectado = nullptr;
+        est.alocacoes_laco = alocacoes_heap.load(std::memory_order_relaxed) - alocacoes_antes -
+                             (memoria->alocacoes_feitas() - alocacoes_memoria);
+        if(opcoes.ciclo_checkpoint == ciclo) gravar_checkpoint(opcoes, ciclo);
+        else if(opcoes.ciclo_checkpoint > ciclo) {
+            erro_ckp = "A execucao terminou no ciclo " + std::to_string(ciclo - 1) + ", antes do checkpoint (" +
+                       std::to_string(opcoes.ciclo_checkpoint) + ")";
+        }
+        
+        // Estado final
+        if(completo) imprimir_estado(ciclo);
+        if(opcoes.trace) {
+            registrar_trace(*opcoes.trace, ciclo, estado, textos_gravados);
+            opcoes.trace->finalizar(ciclo - 1);
+        }
+        if(linha_tempo) {
+            linha_tempo->finalizar();
+            linha_tempo = nullptr;
+        }
+        est.ciclos = ciclo - 1;
+        if(opcoes.verbosidade != Verbosidade::NENHUMA) {
+            printf("\n====== EXECUCAO FINALIZADA em %d ciclos ======\n", ciclo - 1);
+            imprimir_estatisticas();
+        }
+        return ciclo - 1;
+    }
+};
+
+/* Escolhe a forma que casa com os tamanhos de 'cfg' (a primeira predefinida
+   que casar, senão a dinâmica) e chama f(Forma()). Com especializar = false
+   usa sempre a forma dinâmica, para comparação. */
+template<class F>
+auto com_forma(const ConfigMaquina&, F&& f, bool, ListaFormas<>) {
+    return f(FormaDinamica());
+}
+
+template<class F, class Forma, class... Resto>
+auto com_forma(const ConfigMaquina& cfg, F&& f, bool especializar, ListaFormas<Forma, Resto...>) {
+    if(especializar && Forma::aceita(cfg)) return f(Forma());
+    return com_forma(cfg, f, especializar, ListaFormas<Resto...>());
+}
+
+template<class F>
+auto com_forma(const ConfigMaquina& cfg, F&& f, bool especializar = true) {
+    return com_forma(cfg, f, especializar, FormasPredefinidas());
+}
+
+// Cria o simulador da forma escolhida por com_forma() e chama f(sim)
+template<class F>
+auto com_simulador(const ConfigMaquina& cfg, F&& f, bool especializar = true) {
+    return com_forma(cfg, [&](auto forma) {
+        SimuladorTomasulo<decltype(forma)> sim(cfg);
+        return f(sim);
+    }, especializar);
+}
+
+} // namespace tomasulo
+
+#endif
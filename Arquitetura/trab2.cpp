@@ -1,715 +1,1393 @@
 /* tomasulo.cpp
    Simulador do algoritmo de Tomasulo - ciclo a ciclo, com RS, ROB, Load/Store buffers.
-   Compilar: g++ -std=c++17 -O2 -o tomasulo tomasulo.cpp
+   Linha de comando sobre a biblioteca tomasulo.h.
+   Compilar: g++ -std=c++17 -O2 -pthread -o tomasulo tomasulo.cpp
 */
 
-#include <iostream>
-#include <fstream>
-#include <sstream>
-#include <string>
-#include <vector>
-#include <array>
-#include <cstring>
-#include <cctype>
-#include <algorithm>
+#include "tomasulo.h"
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
 
 using namespace std;
+using namespace tomasulo;
 
-// Configuráveis: tamanhos das estruturas
-constexpr int MAX_INS = 256;
-constexpr int REGISTRADORES = 32;
-constexpr int TAM_MEM = 1024;
-constexpr int RS_SOMA_COUNT = 6;
-constexpr int RS_MUL_COUNT = 3;
-constexpr int BUFFER_CARGA_COUNT = 4;
-constexpr int BUFFER_ARM_COUNT = 4;
-constexpr int TAM_ROB = 32;
-
-// Latências (em ciclos)
-constexpr int LAT_SOMA = 2;
-constexpr int LAT_MUL = 10;
-constexpr int LAT_DIV = 40;
-constexpr int LAT_CARGA = 2;
-constexpr int LAT_ARM = 2;
-
-enum class TipoOp { ADD, SUB, MUL, DIV, LD, ST, NOP };
-
-// Representação de uma instrução
-struct Instr {
-    TipoOp tipo = TipoOp::NOP;
-    int dest = 0;
-    int src1 = 0;
-    int src2 = 0;
-    int imm = 0;
-    string texto;
-};
+// Com --verificar-alocacoes, conta as alocações em alocacoes_heap (ver
+// tomasulo.h). Ligado em main() antes de qualquer thread ser criada
+static bool contar_alocacoes = false;
 
-// Estação de reserva para operações aritméticas
-struct EstacaoReserva {
-    bool ocupada = false;
-    TipoOp op = TipoOp::NOP;
-    int Vj = 0, Vk = 0;
-    int Qj = 0, Qk = 0;
-    int destRob = 0;
-    bool executando = false;
-    int ciclosExecRestantes = 0;
-    int indice_rob = 0;
-    string nome;
-};
+void* operator new(size_t n) {
+    if(contar_alocacoes) alocacoes_heap.fetch_add(1, memory_order_relaxed);
+    if(void* p = malloc(n ? n : 1)) return p;
+    throw bad_alloc();
+}
 
-// Buffer para operações de memória (load/store)
-struct BufferMem {
-    bool ocupado = false;
-    TipoOp op = TipoOp::NOP;
-    int endereco = 0;
-    int V = 0;
-    int Q = 0;
-    int indice_rob = 0;
-    bool executando = false;
-    int ciclosExecRestantes = 0;
-    string nome;
-};
+// O GCC reclama de free() em ponteiro de new quando vê as duas pontas
+// inlinadas; aqui elas são de fato o mesmo alocador
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wmismatched-new-delete"
+#endif
+void operator delete(void* p) noexcept { free(p); }
+void operator delete(void* p, size_t) noexcept { free(p); }
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic pop
+#endif
+
+// Reconstrói o estado a partir de um trace binário e o imprime no mesmo
+// formato de imprimir_estado(), opcionalmente só no intervalo [inicio, fim].
+int decodificar_trace(const string& arquivo, int inicio, int fim) {
+    LeitorTrace leitor;
+    if(!leitor.abrir(arquivo) || leitor.parametros.size() != 9) {
+        cerr << "Trace invalido ou ilegivel: " << arquivo << endl;
+        return 1;
+    }
+    
+    // A máquina do trace é recriada a partir dos parâmetros do cabeçalho
+    const vector<int>& p = leitor.parametros;
+    ConfigMaquina cfg;
+    cfg.rs_soma_count = p[2];
+    cfg.rs_mul_count = p[3];
+    cfg.buffer_carga_count = p[4];
+    cfg.buffer_arm_count = p[5];
+    cfg.tam_rob = p[6];
+    cfg.largura_emissao = p[7];
+    cfg.largura_commit = p[8];
+    return com_simulador(cfg, [&](auto& sim) {
+        if(p != sim.parametros_maquina()) {
+            cerr << "Trace gerado com outra configuracao de maquina" << endl;
+            return 1;
+        }
+        leitor.estado.assign(sim.tamanho_estado(), 0);
+        
+        bool intervalo_completo = inicio <= 1 && fim <= 0;
+        int anterior = 0;
+        int ciclo;
+        while((ciclo = leitor.proximo()) != 0) {
+            bool dentro = ciclo >= inicio && (fim <= 0 || ciclo <= fim);
+            for(const auto& [endereco, valor] : leitor.escritas) sim.escrever_memoria(endereco, valor);
+            if(dentro || anterior == 0) sim.restaurar_estado(leitor.estado, leitor.textos);
+            // O cabeçalho usa o total de instruções conhecido no primeiro ciclo
+            if(intervalo_completo && anterior == 0) sim.imprimir_cabecalho(false);
+            if(dentro) {
+                if(anterior > 0 && ciclo > anterior + 1) {
+                    printf("... %d ciclos ociosos pulados (%d a %d)\n",
+                           ciclo - anterior - 1, anterior + 1, ciclo - 1);
+                }
+                sim.imprimir_estado(ciclo);
+            }
+            anterior = ciclo;
+        }
+        
+        if(intervalo_completo) {
+            printf("\n====== EXECUCAO FINALIZADA em %d ciclos ======\n", leitor.total_ciclos);
+        }
+        return 0;
+    });
+}
 
-// Entrada do ROB (Reorder Buffer)
-struct EntradaROB {
-    bool ocupada = false;
-    TipoOp op = TipoOp::NOP;
-    int dest = -1;
-    bool pronta = false;
-    int valor = 0;
-    string texto_instr;
-    int endereco_mem = 0;
-    int valor_arm = 0;
+/* Gerador de programas sintéticos. O programa é sempre o mesmo para a mesma
+   semente e os mesmos parâmetros (gerador de números próprio, sem depender
+   das distribuições da biblioteca padrão). As instruções são distribuídas em
+   rodízio entre 'cadeias' cadeias independentes, cada uma com seu grupo de
+   registradores; cada operando fonte vem de uma instrução anterior da mesma
+   cadeia, a uma distância com distribuição geométrica de média 'distancia'
+   (limitada pelo número de registradores do grupo). */
+struct ParametrosGerador {
+    long long instrucoes = 1000;
+    uint64_t semente = 1;
+    // Pesos de ADD, SUB, MUL, DIV, LD, ST
+    array<double, 6> mix = { 30, 20, 15, 5, 20, 10 };
+    double distancia = 4;       // distância média de dependência (na cadeia)
+    int cadeias = 1;
+    double densidade_arm = -1;  // fração de ST; se >= 0, substitui o peso de ST
 };
 
-// Registrador do banco de registradores
-struct Registrador {
-    int valor = 0;
-    int tag = 0;
+// xorshift64*: determinístico em qualquer plataforma
+struct Aleatorio {
+    uint64_t estado;
+    explicit Aleatorio(uint64_t semente) : estado(semente * 0x9e3779b97f4a7c15ULL + 1) {}
+    uint64_t proximo() {
+        estado ^= estado >> 12;
+        estado ^= estado << 25;
+        estado ^= estado >> 27;
+        return estado * 0x2545f4914f6cdd1dULL;
+    }
+    double uniforme() { return (proximo() >> 11) * (1.0 / 9007199254740992.0); }
+    int ate(int n) { return (int)(proximo() % (uint64_t)n); }
 };
 
-class SimuladorTomasulo {
-private:
-    // Fila de instruções e PC
-    vector<Instr> filaInstr;
-    int pc = 0;
+// "instrucoes=1000,semente=7,mix=30/20/15/5/20/10,distancia=4,cadeias=2,arm=0.1"
+bool ler_parametros_gerador(const string& texto, ParametrosGerador& g) {
+    stringstream ss(texto);
+    string item;
+    while(getline(ss, item, ',')) {
+        size_t igual = item.find('=');
+        if(igual == string::npos) return false;
+        string chave = item.substr(0, igual), valor = item.substr(igual + 1);
+        char* fim = nullptr;
+        if(chave == "instrucoes") g.instrucoes = strtoll(valor.c_str(), &fim, 10);
+        else if(chave == "semente") g.semente = strtoull(valor.c_str(), &fim, 10);
+        else if(chave == "distancia") g.distancia = strtod(valor.c_str(), &fim);
+        else if(chave == "cadeias") g.cadeias = (int)strtol(valor.c_str(), &fim, 10);
+        else if(chave == "arm") g.densidade_arm = strtod(valor.c_str(), &fim);
+        else if(chave == "mix") {
+            if(sscanf(valor.c_str(), "%lf/%lf/%lf/%lf/%lf/%lf", &g.mix[0], &g.mix[1], &g.mix[2],
+                      &g.mix[3], &g.mix[4], &g.mix[5]) != 6) return false;
+            continue;
+        }
+        else return false;
+        if(!fim || *fim) return false;
+    }
+    double soma = 0;
+    for(double w : g.mix) {
+        if(w < 0) return false;
+        soma += w;
+    }
+    return g.instrucoes > 0 && g.distancia >= 1 && soma > 0 && g.densidade_arm <= 1 &&
+           g.cadeias >= 1 && g.cadeias <= REGISTRADORES - 1;
+}
+
+// Gera o programa, entregando uma instrução de cada vez a 'saida'
+void gerar_programa(const ParametrosGerador& g, const function<void(const Instr&)>& saida) {
+    Aleatorio rng(g.semente);
+    
+    array<double, 6> pesos = g.mix;
+    if(g.densidade_arm >= 0) {
+        double outros = pesos[0] + pesos[1] + pesos[2] + pesos[3] + pesos[4];
+        for(int k = 0; k < 5; k++) pesos[k] = outros > 0 ? pesos[k] / outros * (1 - g.densidade_arm) : 0;
+        pesos[5] = g.densidade_arm;
+    }
+    double total = 0;
+    for(double w : pesos) total += w;
+    const TipoOp ops[6] = { TipoOp::ADD, TipoOp::SUB, TipoOp::MUL, TipoOp::DIV, TipoOp::LD, TipoOp::ST };
+    
+    // R1-R31 divididos entre as cadeias; hist guarda, em ordem, os destinos
+    // das últimas escritas de cada cadeia
+    struct Cadeia {
+        vector<int> regs;
+        vector<int> hist;
+        int proximo = 0;
+    };
+    vector<Cadeia> cadeias(g.cadeias);
+    for(int r = 1; r < REGISTRADORES; r++) cadeias[(r - 1) % g.cadeias].regs.push_back(r);
     
-    // Estruturas do algoritmo de Tomasulo
-    array<EstacaoReserva, RS_SOMA_COUNT> RS_soma;
-    array<EstacaoReserva, RS_MUL_COUNT> RS_mul;
-    array<BufferMem, BUFFER_CARGA_COUNT> BufferCarga;
-    array<BufferMem, BUFFER_ARM_COUNT> BufferArm;
-    array<EntradaROB, TAM_ROB + 1> ROB;
-    int cabeca_rob = 1, cauda_rob = 1;
-    array<Registrador, REGISTRADORES> arquivo_reg;
-    array<int, TAM_MEM> memoria;
+    long long emitidas = 0;
+    auto emitir = [&](const Instr& ins) {
+        if(emitidas++ < g.instrucoes) saida(ins);
+    };
+    
+    // Valores iniciais não nulos em todos os registradores usados
+    for(Cadeia& c : cadeias) {
+        for(int r : c.regs) {
+            Instr ins;
+            ins.tipo = TipoOp::LD;
+            ins.dest = r;
+            ins.imm = 1 + rng.ate(100);
+            emitir(ins);
+            c.hist.push_back(r);
+        }
+    }
+    
+    double p = 1.0 / g.distancia;   // distância geométrica em {1, 2, ...}, média 1/p
+    for(long long i = 0; emitidas < g.instrucoes; i++) {
+        Cadeia& c = cadeias[i % g.cadeias];
+        int tam = (int)c.regs.size();
+        auto fonte = [&]() {
+            int d = 1;
+            while(d < tam && rng.uniforme() >= p) d++;
+            return c.hist[(c.hist.size() - d) % c.hist.size()];
+        };
+        
+        double x = rng.uniforme() * total;
+        int k = 0;
+        while(k < 5 && x >= pesos[k]) x -= pesos[k++];
+        
+        Instr ins;
+        ins.tipo = ops[k];
+        if(ins.tipo == TipoOp::ST) {
+            ins.src1 = fonte();
+            ins.imm = rng.ate(REGIAO_DADOS);
+        } else {
+            if(ins.tipo == TipoOp::LD) {
+                ins.imm = rng.ate(1000);
+            } else {
+                ins.src1 = fonte();
+                ins.src2 = fonte();
+            }
+            // Destino em rodízio dentro do grupo: o valor lido a distância
+            // d < tam ainda não foi sobrescrito
+            ins.dest = c.regs[c.proximo];
+            c.proximo = (c.proximo + 1) % tam;
+            c.hist.erase(c.hist.begin());
+            c.hist.push_back(ins.dest);
+        }
+        emitir(ins);
+    }
+}
 
-public:
-    SimuladorTomasulo() {
-        memoria.fill(0);
+shared_ptr<const ImagemPrograma> gerar_imagem(const ParametrosGerador& g) {
+    MontadorPrograma m;
+    gerar_programa(g, [&](const Instr& ins) { m.adicionar(ins); });
+    auto img = make_shared<ImagemPrograma>();
+    img->montar(m);
+    return img;
+}
+
+bool gravar_programa_gerado(const ParametrosGerador& g, const string& arquivo) {
+    FILE* out = arquivo == "-" ? stdout : fopen(arquivo.c_str(), "w");
+    if(!out) return false;
+    gerar_programa(g, [&](const Instr& ins) {
+        fprintf(out, "%s\n", formatar_instr(ins).c_str());
+    });
+    bool ok = !ferror(out);
+    if(out != stdout) ok = fclose(out) == 0 && ok;
+    return ok;
+}
+
+/* Varredura do espaço de projeto: cada eixo da grade é um parâmetro da
+   máquina com uma lista de valores; todas as combinações são simuladas
+   para todos os programas, sem saída, num pool de threads. */
+struct EixoVarredura {
+    const ParametroMaquina* parametro;
+    vector<int> valores;
+};
+
+// Lê "2,4,8" ou "ini:fim[:passo]" (intervalo fechado)
+bool ler_lista_valores(const string& texto, vector<int>& valores) {
+    int ini, fim, passo = 1;
+    if(texto.find(':') != string::npos) {
+        if(sscanf(texto.c_str(), "%d:%d:%d", &ini, &fim, &passo) < 2 || passo <= 0) return false;
+        for(int v = ini; v <= fim; v += passo) valores.push_back(v);
+        return !valores.empty();
     }
+    stringstream ss(texto);
+    string item;
+    while(getline(ss, item, ',')) {
+        char* fim_num;
+        long v = strtol(item.c_str(), &fim_num, 10);
+        if(item.empty() || *fim_num != '\0') return false;
+        valores.push_back((int)v);
+    }
+    return !valores.empty();
+}
 
+// Lê "NOME=VALOR" ou "NOME=lista" para um parâmetro da máquina
+bool ler_atribuicao(const string& texto, const ParametroMaquina*& parametro, vector<int>& valores) {
+    size_t igual = texto.find('=');
+    if(igual == string::npos) return false;
+    parametro = buscar_parametro(texto.substr(0, igual));
+    if(!parametro || !ler_lista_valores(texto.substr(igual + 1), valores)) return false;
+    for(int v : valores) {
+        if(v < parametro->minimo || v > parametro->maximo) return false;
+    }
+    return true;
+}
 
-    const char* nomeOp(TipoOp t) const {
-        switch(t) {
-            case TipoOp::ADD: return "ADD";
-            case TipoOp::SUB: return "SUB";
-            case TipoOp::MUL: return "MUL";
-            case TipoOp::DIV: return "DIV";
-            case TipoOp::LD:  return "LD";
-            case TipoOp::ST:  return "ST";
-            default: return "NOP";
+// Produto cartesiano dos eixos sobre a configuração base
+vector<ConfigMaquina> expandir_grade(const ConfigMaquina& base, const vector<EixoVarredura>& eixos) {
+    vector<ConfigMaquina> configs = { base };
+    for(const auto& eixo : eixos) {
+        vector<ConfigMaquina> expandidas;
+        for(const auto& c : configs) {
+            for(int v : eixo.valores) {
+                ConfigMaquina nova = c;
+                nova.*(eixo.parametro->campo) = v;
+                expandidas.push_back(nova);
+            }
         }
+        configs.swap(expandidas);
     }
+    return configs;
+}
 
-    void trim(string& s) {
-        s.erase(s.begin(), find_if(s.begin(), s.end(), [](unsigned char ch) {
-            return !isspace(ch);
-        }));
-        s.erase(find_if(s.rbegin(), s.rend(), [](unsigned char ch) {
-            return !isspace(ch);
-        }).base(), s.end());
-    }
+/* Pool de threads com roubo de trabalho: cada thread tem sua própria fila
+   de tarefas e consome do fim dela; quando esvazia, rouba do início da
+   fila de outra thread. As tarefas são independentes e não geram novas
+   tarefas, então uma thread termina quando não encontra nada para roubar. */
+class PoolRoubo {
+private:
+    struct Fila {
+        mutex m;
+        deque<size_t> tarefas;
+    };
+    vector<Fila> filas;
 
-    int indiceRegistrador(const string& tok) {
-        if(tok.empty() || tolower(tok[0]) != 'r') return -1;
-        return stoi(tok.substr(1));
+    bool pegar_propria(size_t id, size_t& tarefa) {
+        lock_guard<mutex> trava(filas[id].m);
+        if(filas[id].tarefas.empty()) return false;
+        tarefa = filas[id].tarefas.back();
+        filas[id].tarefas.pop_back();
+        return true;
     }
 
-    TipoOp parseOp(const string& s) {
-        string lower = s;
-        transform(lower.begin(), lower.end(), lower.begin(), ::tolower);
-        
-        if(lower == "add") return TipoOp::ADD;
-        if(lower == "sub") return TipoOp::SUB;
-        if(lower == "mul") return TipoOp::MUL;
-        if(lower == "div") return TipoOp::DIV;
-        if(lower == "ld" || lower == "lda" || lower == "li") return TipoOp::LD;
-        if(lower == "st" || lower == "sd") return TipoOp::ST;
-        return TipoOp::NOP;
+    bool roubar(size_t id, size_t& tarefa) {
+        for(size_t k = 1; k < filas.size(); k++) {
+            Fila& vitima = filas[(id + k) % filas.size()];
+            lock_guard<mutex> trava(vitima.m);
+            if(!vitima.tarefas.empty()) {
+                tarefa = vitima.tarefas.front();
+                vitima.tarefas.pop_front();
+                return true;
+            }
+        }
+        return false;
     }
 
+public:
+    explicit PoolRoubo(size_t nthreads) : filas(max<size_t>(nthreads, 1)) {}
 
-    void carregarPrograma(const string& filename) {
-        ifstream f(filename);
-        if(!f) {
-            cerr << "Erro ao abrir arquivo: " << filename << endl;
-            exit(1);
+    // Executa f(0) ... f(ntarefas - 1) e espera todas terminarem
+    void executar(size_t ntarefas, const function<void(size_t)>& f) {
+        size_t n = filas.size();
+        // Blocos contíguos por thread; o roubo equilibra o que sobrar
+        for(size_t t = 0; t < ntarefas; t++) {
+            filas[t * n / max<size_t>(ntarefas, 1)].tarefas.push_back(t);
         }
-
-        string linha;
-        filaInstr.clear();
         
-        while(getline(f, linha)) {
-            trim(linha);
-            if(linha.empty() || linha[0] == '#') continue;
-            
-            Instr ins;
-            ins.texto = linha;
-            
-            istringstream iss(linha);
-            string op;
-            iss >> op;
-            
-            ins.tipo = parseOp(op);
-            
-            // Parse para instruções aritméticas (ADD, SUB, MUL, DIV)
-            if(ins.tipo == TipoOp::ADD || ins.tipo == TipoOp::SUB || 
-               ins.tipo == TipoOp::MUL || ins.tipo == TipoOp::DIV) {
-                string args;
-                getline(iss, args);
-                
-                size_t pos1 = args.find(',');
-                size_t pos2 = args.find(',', pos1 + 1);
-                
-                if(pos1 != string::npos && pos2 != string::npos) {
-                    string rd = args.substr(0, pos1);
-                    string rs = args.substr(pos1 + 1, pos2 - pos1 - 1);
-                    string rt = args.substr(pos2 + 1);
-                    
-                    trim(rd); trim(rs); trim(rt);
-                    ins.dest = indiceRegistrador(rd);
-                    ins.src1 = indiceRegistrador(rs);
-                    ins.src2 = indiceRegistrador(rt);
+        vector<thread> threads;
+        for(size_t id = 0; id < n; id++) {
+            threads.emplace_back([this, id, &f] {
+                size_t tarefa;
+                while(pegar_propria(id, tarefa) || roubar(id, tarefa)) {
+                    f(tarefa);
                 }
-            } 
-            // Parse para instruções de load (carregamento imediato)
-            else if(ins.tipo == TipoOp::LD) {
-                string args;
-                getline(iss, args);
-                
-                size_t pos = args.find(',');
-                if(pos != string::npos) {
-                    string rd = args.substr(0, pos);
-                    string immediate = args.substr(pos + 1);
-                    
-                    trim(rd); trim(immediate);
-                    ins.dest = indiceRegistrador(rd);
-                    ins.imm = stoi(immediate);
-                }
-            } 
-            // Parse para instruções de store
-            else if(ins.tipo == TipoOp::ST) {
-                string args;
-                getline(iss, args);
-                
-                size_t pos = args.find(',');
-                if(pos != string::npos) {
-                    string rs = args.substr(0, pos);
-                    string endereco = args.substr(pos + 1);
-                    
-                    trim(rs); trim(endereco);
-                    ins.src1 = indiceRegistrador(rs);
-                    ins.imm = stoi(endereco);
-                }
-            }
-            
-            filaInstr.push_back(ins);
-            if(filaInstr.size() >= MAX_INS - 1) break;
+            });
         }
-        f.close();
+        for(auto& t : threads) t.join();
     }
+};
 
+struct ResultadoVarredura {
+    size_t config;
+    size_t programa;
+    size_t instrucoes;
+    int ciclos;
+};
 
-    int slots_livres_rob() const {
-        int usado = (cauda_rob - cabeca_rob + TAM_ROB) % TAM_ROB;
-        return TAM_ROB - usado - 1;
+void escrever_resultados(FILE* out, bool json, const vector<ConfigMaquina>& configs,
+                         const vector<string>& programas, const vector<ResultadoVarredura>& resultados) {
+    if(json) fprintf(out, "[\n");
+    else {
+        fprintf(out, "programa");
+        for(const auto& p : PARAMETROS_MAQUINA) fprintf(out, ",%s", p.nome);
+        fprintf(out, ",instrucoes,ciclos,ipc\n");
     }
+    
+    for(size_t i = 0; i < resultados.size(); i++) {
+        const ResultadoVarredura& r = resultados[i];
+        const ConfigMaquina& c = configs[r.config];
+        double ipc = r.ciclos > 0 ? (double)r.instrucoes / r.ciclos : 0.0;
+        if(json) {
+            fprintf(out, "  {\"programa\": \"%s\"", programas[r.programa].c_str());
+            for(const auto& p : PARAMETROS_MAQUINA) fprintf(out, ", \"%s\": %d", p.nome, c.*(p.campo));
+            fprintf(out, ", \"instrucoes\": %zu, \"ciclos\": %d, \"ipc\": %.4f}%s\n",
+                    r.instrucoes, r.ciclos, ipc, i + 1 < resultados.size() ? "," : "");
+        } else {
+            fprintf(out, "%s", programas[r.programa].c_str());
+            for(const auto& p : PARAMETROS_MAQUINA) fprintf(out, ",%d", c.*(p.campo));
+            fprintf(out, ",%zu,%d,%.4f\n", r.instrucoes, r.ciclos, ipc);
+        }
+    }
+    if(json) fprintf(out, "]\n");
+}
 
-    int alocar_rob() {
-        int proximo = cauda_rob;
-        ROB[proximo] = EntradaROB();
-        ROB[proximo].ocupada = true;
-        cauda_rob = (cauda_rob % TAM_ROB) + 1;
-        return proximo;
+int executar_varredura(const ConfigMaquina& base, const vector<EixoVarredura>& eixos,
+                       const vector<string>& arquivos, const string& saida, size_t nthreads,
+                       const string& dir_cache, const ParametrosGerador* gerador, bool especializar) {
+    // Cada programa é lido uma vez e compartilhado por todas as simulações
+    vector<shared_ptr<const ImagemPrograma>> programas;
+    vector<string> nomes = arquivos;
+    for(const string& arq : arquivos) {
+        string erro;
+        auto prog = carregar_imagem(arq, dir_cache, erro);
+        if(!prog) {
+            cerr << erro << endl;
+            return 1;
+        }
+        programas.push_back(prog);
+    }
+    if(gerador) {
+        programas.push_back(gerar_imagem(*gerador));
+        nomes.push_back("gerado");
+    }
+    
+    vector<ConfigMaquina> configs = expandir_grade(base, eixos);
+    for(const ConfigMaquina& cfg : configs) {
+        if(!regs_fisicos_suficientes(cfg, 1)) {
+            cerr << "REGS_FISICOS=" << cfg.regs_fisicos << " na grade precisa ser 0 ou maior que "
+                 << REGISTRADORES << endl;
+            return 1;
+        }
+        string erro = erro_cache(cfg);
+        if(!erro.empty()) {
+            cerr << erro << " (na grade)" << endl;
+            return 1;
+        }
+    }
+    vector<ResultadoVarredura> resultados(configs.size() * programas.size());
+    
+    PoolRoubo pool(nthreads);
+    pool.executar(resultados.size(), [&](size_t t) {
+        ResultadoVarredura& r = resultados[t];
+        r.config = t / programas.size();
+        r.programa = t % programas.size();
+        
+        com_simulador(configs[r.config], [&](auto& sim) {
+            sim.definir_programa(programas[r.programa]);
+            OpcoesExecucao opcoes;
+            opcoes.verbosidade = Verbosidade::NENHUMA;
+            opcoes.dirigido_eventos = true;
+            r.ciclos = sim.executar(opcoes);
+            r.instrucoes = sim.estatisticas().consolidadas;
+        }, especializar);
+    });
+    
+    FILE* out = saida.empty() ? stdout : fopen(saida.c_str(), "w");
+    if(!out) {
+        cerr << "Erro ao criar arquivo de saida: " << saida << endl;
+        return 1;
     }
+    bool json = saida.size() >= 5 && saida.compare(saida.size() - 5, 5, ".json") == 0;
+    escrever_resultados(out, json, configs, nomes, resultados);
+    if(out != stdout) fclose(out);
+    return 0;
+}
+
+/* Benchmark do próprio simulador (desempenho no hospedeiro). Núcleos
+   sintéticos representativos, gerados sempre iguais; cada um é simulado sem
+   saída 'repeticoes' vezes (conta a mediana) e mais uma vez medindo o tempo
+   de cada estágio, que é reportado em ns por ciclo simulado. */
+struct NucleoBenchmark {
+    string nome;
+    shared_ptr<const ImagemPrograma> programa;
+};
+
+Instr nova_instr(TipoOp tipo, int dest, int src1, int src2, int imm = 0) {
+    Instr ins;
+    ins.tipo = tipo;
+    ins.dest = dest;
+    ins.src1 = src1;
+    ins.src2 = src2;
+    ins.imm = imm;
+    return ins;
+}
 
-    EntradaROB* entrada_rob(int tag) {
-        if(tag < 1 || tag > TAM_ROB) return nullptr;
-        return &ROB[tag];
+vector<NucleoBenchmark> nucleos_benchmark(int n) {
+    vector<NucleoBenchmark> nucleos;
+    auto adicionar = [&](const char* nome, MontadorPrograma& m) {
+        auto img = make_shared<ImagemPrograma>();
+        img->montar(m);
+        nucleos.push_back({ nome, img });
+    };
+    
+    // Cadeia longa de ADDs dependentes: um resultado por LAT_SOMA ciclos
+    MontadorPrograma cadeia;
+    cadeia.adicionar(nova_instr(TipoOp::LD, 1, 0, SEM_BASE, 1));
+    cadeia.adicionar(nova_instr(TipoOp::LD, 2, 0, SEM_BASE, 1));
+    for(int i = 2; i < n; i++) cadeia.adicionar(nova_instr(TipoOp::ADD, 1, 1, 2));
+    adicionar("cadeia_add", cadeia);
+    
+    // Fluxo independente: R1-R24 escritos em rodízio, fontes R25-R31 fixas
+    MontadorPrograma indep;
+    for(int r = 25; r < REGISTRADORES; r++) indep.adicionar(nova_instr(TipoOp::LD, r, 0, SEM_BASE, r));
+    for(int i = indep.tamanho(); i < n; i++) {
+        TipoOp op = i % 3 == 0 ? TipoOp::LD : (i % 3 == 1 ? TipoOp::ADD : TipoOp::SUB);
+        indep.adicionar(nova_instr(op, 1 + i % 24, 25 + i % 7,
+                                   op == TipoOp::LD ? SEM_BASE : 25 + (i + 3) % 7, i % 100));
+    }
+    adicionar("independente", indep);
+    
+    // MUL/DIV: uma DIV a cada 8, dependência a 5 instruções de distância
+    MontadorPrograma muldiv;
+    for(int r = 1; r <= 8; r++) muldiv.adicionar(nova_instr(TipoOp::LD, r, 0, SEM_BASE, r + 1));
+    muldiv.adicionar(nova_instr(TipoOp::LD, 31, 0, SEM_BASE, 3));
+    for(int i = muldiv.tamanho(); i < n; i++) {
+        TipoOp op = i % 8 == 0 ? TipoOp::DIV : TipoOp::MUL;
+        muldiv.adicionar(nova_instr(op, 1 + i % 8, 1 + (i + 3) % 8, 31));
     }
-    template<size_t N>
-    int encontrar_rs_livre(array<EstacaoReserva, N>& rs) {
-        for(size_t i = 0; i < N; i++) {
-            if(!rs[i].ocupada) return i;
+    adicionar("mul_div", muldiv);
+    
+    // Armazenamentos: dois ST para cada LD
+    MontadorPrograma arm;
+    for(int i = 0; i < n; i++) {
+        int r = 1 + (i / 3) % 16;
+        if(i % 3 == 0) arm.adicionar(nova_instr(TipoOp::LD, r, 0, SEM_BASE, i));
+        else arm.adicionar(nova_instr(TipoOp::ST, 0, r, SEM_BASE, i % REGIAO_DADOS));
+    }
+    adicionar("armazenamento", arm);
+    return nucleos;
+}
+
+struct ResultadoBenchmark {
+    string nucleo;
+    long long instrucoes = 0;
+    int ciclos = 0;
+    double segundos = 0, segundos_min = 0, segundos_max = 0;
+    TemposEstagio tempos;   // ns por ciclo
+};
+
+void escrever_benchmark(FILE* out, bool json, const vector<ResultadoBenchmark>& resultados) {
+    if(json) fprintf(out, "[\n");
+    else fprintf(out, "nucleo,instrucoes,ciclos,segundos,segundos_min,segundos_max,ciclos_por_s,"
+                      "instrucoes_por_s,ns_emitir,ns_iniciar,ns_avancar,ns_consolidar\n");
+    for(size_t i = 0; i < resultados.size(); i++) {
+        const ResultadoBenchmark& r = resultados[i];
+        double cps = r.segundos > 0 ? r.ciclos / r.segundos : 0.0;
+        double ips = r.segundos > 0 ? r.instrucoes / r.segundos : 0.0;
+        if(json) {
+            fprintf(out, "  {\"nucleo\": \"%s\", \"instrucoes\": %lld, \"ciclos\": %d, "
+                         "\"segundos\": %.6f, \"segundos_min\": %.6f, \"segundos_max\": %.6f, "
+                         "\"ciclos_por_s\": %.0f, \"instrucoes_por_s\": %.0f, "
+                         "\"ns_por_ciclo\": {\"emitir\": %.2f, \"iniciar\": %.2f, "
+                         "\"avancar_execucao_e_escrever\": %.2f, \"consolidar\": %.2f}}%s\n",
+                    r.nucleo.c_str(), r.instrucoes, r.ciclos, r.segundos, r.segundos_min,
+                    r.segundos_max, cps, ips, r.tempos.emitir, r.tempos.iniciar,
+                    r.tempos.avancar, r.tempos.consolidar, i + 1 < resultados.size() ? "," : "");
+        } else {
+            fprintf(out, "%s,%lld,%d,%.6f,%.6f,%.6f,%.0f,%.0f,%.2f,%.2f,%.2f,%.2f\n",
+                    r.nucleo.c_str(), r.instrucoes, r.ciclos, r.segundos, r.segundos_min,
+                    r.segundos_max, cps, ips, r.tempos.emitir, r.tempos.iniciar,
+                    r.tempos.avancar, r.tempos.consolidar);
         }
-        return -1;
     }
+    if(json) fprintf(out, "]\n");
+}
 
-    int encontrar_buffer_carga_livre() {
-        for(size_t i = 0; i < BUFFER_CARGA_COUNT; i++) {
-            if(!BufferCarga[i].ocupado) return i;
+int executar_benchmark(const ConfigMaquina& cfg, bool dirigido_eventos, const vector<string>& arquivos,
+                       const string& dir_cache, const ParametrosGerador* gerador,
+                       int tamanho, int repeticoes, const string& saida, bool especializar) {
+    vector<NucleoBenchmark> nucleos = nucleos_benchmark(tamanho);
+    for(const string& arq : arquivos) {
+        string erro;
+        auto prog = carregar_imagem(arq, dir_cache, erro);
+        if(!prog) {
+            cerr << erro << endl;
+            return 1;
+        }
+        nucleos.push_back({ arq, prog });
+    }
+    if(gerador) nucleos.push_back({ "gerado", gerar_imagem(*gerador) });
+    
+    vector<ResultadoBenchmark> resultados;
+    for(const NucleoBenchmark& nucleo : nucleos) {
+        ResultadoBenchmark r;
+        r.nucleo = nucleo.nome;
+        OpcoesExecucao opcoes;
+        opcoes.verbosidade = Verbosidade::NENHUMA;
+        opcoes.dirigido_eventos = dirigido_eventos;
+        
+        vector<double> tempos;
+        for(int rep = 0; rep < repeticoes; rep++) {
+            com_simulador(cfg, [&](auto& sim) {
+                sim.definir_programa(nucleo.programa);
+                auto t0 = chrono::steady_clock::now();
+                r.ciclos = sim.executar(opcoes);
+                auto t1 = chrono::steady_clock::now();
+                tempos.push_back(chrono::duration<double>(t1 - t0).count());
+                r.instrucoes = sim.estatisticas().consolidadas;
+            }, especializar);
         }
-        return -1;
+        sort(tempos.begin(), tempos.end());
+        r.segundos = tempos[tempos.size() / 2];
+        r.segundos_min = tempos.front();
+        r.segundos_max = tempos.back();
+        
+        // Rodada separada para os estágios: medir cada um também custa tempo
+        com_simulador(cfg, [&](auto& sim) {
+            sim.definir_programa(nucleo.programa);
+            opcoes.tempos = &r.tempos;
+            sim.executar(opcoes);
+        }, especializar);
+        double medidos = max<long long>(1, r.tempos.ciclos);
+        r.tempos.emitir /= medidos;
+        r.tempos.iniciar /= medidos;
+        r.tempos.avancar /= medidos;
+        r.tempos.consolidar /= medidos;
+        resultados.push_back(r);
+    }
+    
+    FILE* out = saida.empty() ? stdout : fopen(saida.c_str(), "w");
+    if(!out) {
+        cerr << "Erro ao criar arquivo de saida: " << saida << endl;
+        return 1;
     }
+    bool json = saida.size() >= 5 && saida.compare(saida.size() - 5, 5, ".json") == 0;
+    escrever_benchmark(out, json, resultados);
+    if(out != stdout) fclose(out);
+    return 0;
+}
+
+/* Barreira reutilizável entre as threads dos núcleos. A última thread a
+   chegar roda ao_completar(ordem de chegada) antes de liberar as outras,
+   então o que ela escreve é visto por todas depois da barreira. */
+class Barreira {
+private:
+    mutex m;
+    condition_variable cv;
+    size_t participantes;
+    size_t geracao = 0;
+    vector<size_t> chegada;
+
+public:
+    explicit Barreira(size_t n) : participantes(n) { chegada.reserve(n); }
 
-    int encontrar_buffer_arm_livre() {
-        for(size_t i = 0; i < BUFFER_ARM_COUNT; i++) {
-            if(!BufferArm[i].ocupado) return i;
+    template<class F>
+    void esperar(size_t id, F&& ao_completar) {
+        unique_lock<mutex> trava(m);
+        chegada.push_back(id);
+        if(chegada.size() == participantes) {
+            ao_completar(chegada);
+            chegada.clear();
+            geracao++;
+            cv.notify_all();
+            return;
         }
-        return -1;
+        size_t minha = geracao;
+        cv.wait(trava, [&] { return geracao != minha; });
     }
+};
 
-    void emitir() {
-        if(pc >= (int)filaInstr.size()) return;
+/* Vários núcleos, um programa e uma thread cada, com memória de dados
+   compartilhada. Os núcleos andam 'quantum' ciclos e se encontram numa
+   barreira; durante o quantum cada um lê a memória como estava na última
+   barreira mais as próprias escritas, e na barreira as escritas de todos são
+   aplicadas. Com deterministico, na ordem dos núcleos (o resultado não
+   depende do escalonamento do host); senão, na ordem de chegada. */
+int executar_multinucleo(const ConfigMaquina& cfg, const vector<string>& arquivos, const string& dir_cache,
+                         const string& arquivo_memoria, uint32_t base_memoria, int quantum,
+                         bool deterministico, const OpcoesExecucao& opcoes,
+                         const string& arquivo_estatisticas, bool especializar) {
+    shared_ptr<const ImagemMemoria> img;
+    if(!arquivo_memoria.empty()) {
+        string erro;
+        img = carregar_imagem_memoria(arquivo_memoria, base_memoria, erro);
+        if(!img) {
+            cerr << erro << endl;
+            return 1;
+        }
+    }
+    
+    return com_forma(cfg, [&](auto forma) {
+        using Simulador = SimuladorTomasulo<decltype(forma)>;
+        size_t n = arquivos.size();
+        MemoriaPaginada memoria;
+        if(img) memoria.definir_imagem(img);
+        vector<BufferEscritas> buffers(n);
+        vector<unique_ptr<Simulador>> nucleos;
+        for(size_t i = 0; i < n; i++) {
+            nucleos.push_back(make_unique<Simulador>(cfg));
+            if(!nucleos[i]->carregarPrograma(arquivos[i], dir_cache)) {
+                cerr << nucleos[i]->erro_programa() << endl;
+                return 1;
+            }
+            nucleos[i]->compartilhar_memoria(memoria, buffers[i]);
+        }
         
-        Instr& ins = filaInstr[pc];
+        Barreira barreira(n);
+        int limite = quantum;
+        bool terminou = false;
+        auto ao_completar = [&](const vector<size_t>& chegada) {
+            if(deterministico) {
+                for(auto& b : buffers) b.aplicar(memoria);
+            } else {
+                for(size_t i : chegada) buffers[i].aplicar(memoria);
+            }
+            terminou = all_of(nucleos.begin(), nucleos.end(), [](const auto& c) { return c->finalizado(); });
+            limite += quantum;
+        };
         
-        if(slots_livres_rob() <= 0) return;
+        auto inicio = chrono::steady_clock::now();
+        vector<thread> threads;
+        for(size_t i = 0; i < n; i++) {
+            threads.emplace_back([&, i] {
+                while(true) {
+                    nucleos[i]->executar_quantum(limite, opcoes.dirigido_eventos);
+                    barreira.esperar(i, ao_completar);
+                    if(terminou) break;
+                }
+            });
+        }
+        for(auto& t : threads) t.join();
+        double segundos = chrono::duration<double>(chrono::steady_clock::now() - inicio).count();
         
-        // Instruções de load (carregamento imediato)
-        if(ins.tipo == TipoOp::LD) {
-            int idx = encontrar_buffer_carga_livre();
-            if(idx < 0) return;
-            
-            int tag = alocar_rob();
-            
-            BufferCarga[idx].ocupado = true;
-            BufferCarga[idx].op = TipoOp::LD;
-            BufferCarga[idx].endereco = ins.imm;
-            BufferCarga[idx].indice_rob = tag;
-            BufferCarga[idx].Q = 0;
-            BufferCarga[idx].V = 0;
-            BufferCarga[idx].executando = false;
-            BufferCarga[idx].ciclosExecRestantes = 0;
-            BufferCarga[idx].nome = "L" + to_string(idx);
-            
-            EntradaROB* r = entrada_rob(tag);
-            r->ocupada = true;
-            r->op = TipoOp::LD;
-            r->dest = ins.dest;
-            r->pronta = false;
-            r->valor = 0;
-            r->texto_instr = ins.texto;
-            
-            arquivo_reg[ins.dest].tag = tag;
-            pc++;
-        } 
-        // Instruções de store
-        else if(ins.tipo == TipoOp::ST) {
-            int idx = encontrar_buffer_arm_livre();
-            if(idx < 0) return;
-            
-            int tag = alocar_rob();
-            
-            BufferArm[idx].ocupado = true;
-            BufferArm[idx].op = TipoOp::ST;
-            BufferArm[idx].endereco = ins.imm;
-            BufferArm[idx].indice_rob = tag;
-            BufferArm[idx].V = 0;
-            BufferArm[idx].Q = 0;
-            BufferArm[idx].executando = false;
-            BufferArm[idx].ciclosExecRestantes = 0;
-            BufferArm[idx].nome = "S" + to_string(idx);
-            
-            int src = ins.src1;
-            if(arquivo_reg[src].tag == 0) {
-                BufferArm[idx].V = arquivo_reg[src].valor;
-                BufferArm[idx].Q = 0;
-            } else {
-                BufferArm[idx].Q = arquivo_reg[src].tag;
+        for(size_t i = 0; i < n; i++) {
+            if(!nucleos[i]->erro_programa().empty()) {
+                cerr << nucleos[i]->erro_programa() << endl;
+                return 1;
             }
-            
-            EntradaROB* r = entrada_rob(tag);
-            r->ocupada = true;
-            r->op = TipoOp::ST;
-            r->dest = -1;
-            r->pronta = false;
-            r->endereco_mem = ins.imm;
-            r->texto_instr = ins.texto;
-            
-            pc++;
-        } 
-        // Instruções aritméticas
-        else {
-            int idx;
-            EstacaoReserva* rsarr;
-            
-            if(ins.tipo == TipoOp::MUL || ins.tipo == TipoOp::DIV) {
-                idx = encontrar_rs_livre(RS_mul);
-                if(idx < 0) return;
-                rsarr = &RS_mul[idx];
-            } else {
-                idx = encontrar_rs_livre(RS_soma);
-                if(idx < 0) return;
-                rsarr = &RS_soma[idx];
+        }
+        
+        if(opcoes.verbosidade != Verbosidade::NENHUMA) {
+            printf("====== SIMULADOR TOMASULO: %zu NUCLEOS ======\n", n);
+            printf("Quantum de %d ciclos, escritas na barreira em ordem %s\n\n", quantum,
+                   deterministico ? "fixa (deterministico)" : "de chegada");
+            printf("%-6s %-24s %10s %12s %8s\n", "Nucleo", "Programa", "Ciclos", "Instrucoes", "IPC");
+            long long ciclos = 0, instrucoes = 0;
+            for(size_t i = 0; i < n; i++) {
+                const Estatisticas& e = nucleos[i]->estatisticas();
+                printf("%-6zu %-24s %10lld %12lld %8.3f\n", i, arquivos[i].c_str(), e.ciclos, e.consolidadas,
+                       e.ciclos > 0 ? (double)e.consolidadas / e.ciclos : 0.0);
+                ciclos = max(ciclos, e.ciclos);
+                instrucoes += e.consolidadas;
             }
-            
-            int tag = alocar_rob();
-            
-            rsarr->ocupada = true;
-            rsarr->op = ins.tipo;
-            rsarr->destRob = tag;
-            rsarr->indice_rob = tag;
-            rsarr->executando = false;
-            rsarr->ciclosExecRestantes = 0;
-            rsarr->nome = "RS" + to_string(idx);
-            
-            // Verifica dependências para src1
-            if(arquivo_reg[ins.src1].tag == 0) {
-                rsarr->Vj = arquivo_reg[ins.src1].valor;
-                rsarr->Qj = 0;
-            } else {
-                rsarr->Qj = arquivo_reg[ins.src1].tag;
+            printf("\nTotal: %lld instrucoes em %lld ciclos, IPC agregado %.3f (%.3f s no host)\n",
+                   instrucoes, ciclos, ciclos > 0 ? (double)instrucoes / ciclos : 0.0, segundos);
+        }
+        if(opcoes.verbosidade == Verbosidade::COMPLETA) {
+            for(size_t i = 0; i < n; i++) {
+                printf("\n====== NUCLEO %zu: %s ======\n", i, arquivos[i].c_str());
+                nucleos[i]->imprimir_registradores();
+                nucleos[i]->imprimir_estatisticas();
             }
-            
-            // Verifica dependências para src2
-            if(arquivo_reg[ins.src2].tag == 0) {
-                rsarr->Vk = arquivo_reg[ins.src2].valor;
-                rsarr->Qk = 0;
-            } else {
-                rsarr->Qk = arquivo_reg[ins.src2].tag;
+            imprimir_memoria(memoria);
+            printf("\n");
+        }
+        
+        if(!arquivo_estatisticas.empty()) {
+            FILE* out = fopen(arquivo_estatisticas.c_str(), "w");
+            if(!out) {
+                cerr << "Erro ao criar arquivo de estatisticas: " << arquivo_estatisticas << endl;
+                return 1;
             }
-            
-            EntradaROB* r = entrada_rob(tag);
-            r->ocupada = true;
-            r->op = ins.tipo;
-            r->dest = ins.dest;
-            r->pronta = false;
-            r->texto_instr = ins.texto;
-            
-            arquivo_reg[ins.dest].tag = tag;
-            pc++;
+            fprintf(out, "{\"nucleos\": [\n");
+            for(size_t i = 0; i < n; i++) {
+                if(i > 0) fprintf(out, ",\n");
+                nucleos[i]->escrever_estatisticas_json(out);
+            }
+            fprintf(out, "]}\n");
+            fclose(out);
         }
+        return 0;
+    }, especializar);
+}
+
+/* Depurador: controla a simulação por comandos, um por linha, na entrada
+   padrão, e responde cada um com uma linha de JSON na saída padrão. Para usar
+   sobre um socket local, basta ligar os dois lados a ele (ex.: socat).
+     passo [N]                  simula N ciclos (padrão: 1)
+     continuar                  até o fim ou um ponto de parada
+     parar pc|ciclo|commit V [T]    ponto de parada (T = thread)
+     vigiar reg|mem V [T]       vigia de registrador ou de endereço
+     remover ID, pontos         remove / lista pontos de parada
+     estado, regs [T], mem E [N], rob, rs, estatisticas
+     sair
+   Argumentos ausentes ou fora do intervalo são respondidos com {"erro": ...}. */
+template<class Simulador>
+void responder_parada(const Simulador& sim, const ResultadoPasso& r) {
+    printf("{\"parada\": \"%s\", \"ciclo\": %d, \"ponto\": %d, \"pc\": [", NOMES_MOTIVO_PARADA[(int)r.motivo],
+           r.ciclo, r.ponto);
+    for(int th = 0; th < sim.num_threads(); th++) printf("%s%d", th ? ", " : "", sim.pc(th));
+    printf("]}\n");
+}
+
+template<class Simulador>
+void responder_estacoes(const Simulador& sim, Unidade u) {
+    printf("\"%s\": [", NOMES_UNIDADE[(int)u]);
+    bool primeira = true;
+    for(int i = 0; i < sim.estacoes(u); i++) {
+        VisaoEstacao v = sim.estacao(u, i);
+        if(!v.ocupada) continue;
+        printf("%s{\"idx\": %d, \"op\": \"%s\", \"executando\": %s, \"restante\": %d, \"rob\": %d, "
+               "\"vj\": %d, \"vk\": %d, \"qj\": %d, \"qk\": %d, \"endereco\": %d}",
+               primeira ? "" : ", ", i, NOMES_OP[(int)v.op], v.executando ? "true" : "false", v.restante, v.rob,
+               v.Vj, v.Vk, v.Qj, v.Qk, v.endereco);
+        primeira = false;
     }
+    printf("]");
+}
 
-    int latencia_op(TipoOp t) const {
-        switch(t) {
-            case TipoOp::ADD:
-            case TipoOp::SUB: return LAT_SOMA;
-            case TipoOp::MUL: return LAT_MUL;
-            case TipoOp::DIV: return LAT_DIV;
-            case TipoOp::LD: return LAT_CARGA;
-            case TipoOp::ST: return LAT_ARM;
-            default: return 1;
+// Próximo argumento inteiro de um comando: 1 se leu, 0 se a linha acabou,
+// -1 se o texto não é um inteiro
+int ler_argumento(istringstream& ss, long long& v) {
+    string s;
+    if(!(ss >> s)) return 0;
+    char* fim;
+    errno = 0;
+    v = strtoll(s.c_str(), &fim, 10);
+    return *fim == '\0' && errno == 0 ? 1 : -1;
+}
+
+// Maior bloco que 'mem' devolve numa resposta
+constexpr long long MAX_PALAVRAS_DEPURADOR = 4096;
+
+template<class Simulador>
+void depurar(Simulador& sim, bool dirigido_eventos) {
+    sim.definir_dirigido_eventos(dirigido_eventos);
+    string linha;
+    while(getline(cin, linha)) {
+        istringstream ss(linha);
+        string cmd, tipo;
+        ss >> cmd;
+        if(cmd.empty()) continue;
+        if(cmd == "sair") break;
+        long long a, b, c;
+        if(cmd == "passo") {
+            int lido = ler_argumento(ss, a);
+            if(lido < 0 || (lido > 0 && (a < 1 || a > INT32_MAX)) || ss >> tipo) {
+                printf("{\"erro\": \"passo exige N >= 1\"}\n");
+            }
+            else responder_parada(sim, sim.passo(lido ? a : 1));
         }
-    }
-    template<size_t N>
-    void tentar_iniciar_rs(array<EstacaoReserva, N>& rsarr) {
-        for(auto& rs : rsarr) {
-            if(!rs.ocupada || rs.executando) continue;
-            if(rs.Qj == 0 && rs.Qk == 0) {
-                rs.executando = true;
-                rs.ciclosExecRestantes = latencia_op(rs.op);
+        else if(cmd == "continuar") responder_parada(sim, sim.continuar());
+        else if(cmd == "parar" || cmd == "vigiar") {
+            // V é obrigatório; sem T, o ponto vale para qualquer thread
+            ss >> tipo;
+            const char* tipos[] = { "pc", "ciclo", "commit", "reg", "mem" };
+            int t = cmd == "parar" ? 0 : 3, fim = cmd == "parar" ? 3 : 5;
+            while(t < fim && tipo != tipos[t]) t++;
+            bool valido = t < fim && ler_argumento(ss, a) == 1 && a >= 0 && a <= INT32_MAX &&
+                          (t != (int)TipoPontoParada::REGISTRADOR || a < REGISTRADORES);
+            int lido = ler_argumento(ss, b);
+            if(lido == 0) b = -1;
+            valido = valido && lido >= 0 && (lido == 0 || (b >= 0 && b < sim.num_threads())) && !(ss >> tipo);
+            if(!valido) printf("{\"erro\": \"ponto de parada invalido\"}\n");
+            else printf("{\"id\": %d}\n", sim.adicionar_ponto((TipoPontoParada)t, (int)a, (int)b));
+        }
+        else if(cmd == "remover") {
+            if(ler_argumento(ss, a) != 1 || ss >> tipo) printf("{\"erro\": \"remover exige o ID do ponto\"}\n");
+            else printf("{\"removido\": %s}\n", a >= 0 && a <= INT32_MAX && sim.remover_ponto((int)a) ? "true" : "false");
+        }
+        else if(cmd == "pontos") {
+            printf("{\"pontos\": [");
+            const auto& pontos = sim.pontos_parada();
+            for(size_t i = 0; i < pontos.size(); i++) {
+                printf("%s{\"id\": %d, \"tipo\": \"%s\", \"valor\": %d, \"thread\": %d}", i ? ", " : "",
+                       pontos[i].id, NOMES_PONTO_PARADA[(int)pontos[i].tipo], pontos[i].valor, pontos[i].thread);
             }
+            printf("]}\n");
         }
-    }
-
-    void tentar_iniciar_cargas() {
-        for(auto& lb : BufferCarga) {
-            if(!lb.ocupado || lb.executando) continue;
-            lb.executando = true;
-            lb.ciclosExecRestantes = latencia_op(TipoOp::LD);
+        else if(cmd == "estado") {
+            printf("{\"ciclo\": %d, \"fim\": %s, \"pc\": [", sim.ciclo(), sim.finalizado() ? "true" : "false");
+            for(int th = 0; th < sim.num_threads(); th++) printf("%s%d", th ? ", " : "", sim.pc(th));
+            printf("]}\n");
         }
-    }
-
-    void tentar_iniciar_arms() {
-        for(auto& sb : BufferArm) {
-            if(!sb.ocupado || sb.executando) continue;
-            if(sb.Q == 0) {
-                sb.executando = true;
-                sb.ciclosExecRestantes = latencia_op(TipoOp::ST);
+        else if(cmd == "regs") {
+            int lido = ler_argumento(ss, a);
+            if(lido < 0 || (lido > 0 && (a < 0 || a >= sim.num_threads())) || ss >> tipo) {
+                printf("{\"erro\": \"thread invalida\"}\n");
+                fflush(stdout);
+                continue;
+            }
+            const BancoRegistradores& r = sim.registradores(lido ? (int)a : 0);
+            const array<int, REGISTRADORES>* campos[] = { &r.valor, &r.tag, &r.consolidado };
+            const char* nomes[] = { "valor", "tag", "consolidado" };
+            printf("{");
+            for(int c = 0; c < 3; c++) {
+                printf("%s\"%s\": [", c ? ", " : "", nomes[c]);
+                for(int i = 0; i < REGISTRADORES; i++) printf("%s%d", i ? ", " : "", (*campos[c])[i]);
+                printf("]");
+            }
+            printf("}\n");
+        }
+        else if(cmd == "mem") {
+            // E vale de -2^31 a 2^32 - 1 (negativos contam do fim, como no programa)
+            bool tem_endereco = ler_argumento(ss, a) == 1 && a >= INT32_MIN && a <= UINT32_MAX;
+            int lido = ler_argumento(ss, c);
+            if(lido == 0) c = 1;
+            if(!tem_endereco || lido < 0 || ss >> tipo) {
+                printf("{\"erro\": \"mem exige um endereco E\"}\n");
+            }
+            else if(c < 1 || c > MAX_PALAVRAS_DEPURADOR) {
+                printf("{\"erro\": \"mem le de 1 a %lld palavras\"}\n", MAX_PALAVRAS_DEPURADOR);
+            }
+            else {
+                printf("{\"endereco\": %lld, \"valores\": [", a);
+                for(long long i = 0; i < c; i++) printf("%s%d", i ? ", " : "", sim.palavra_memoria((uint32_t)(a + i)));
+                printf("]}\n");
+            }
+        }
+        else if(cmd == "rob") {
+            printf("{\"rob\": [");
+            bool primeira = true;
+            for(int t = 1; t <= sim.tam_rob(); t++) {
+                const EntradaROB& e = sim.rob(t);
+                if(!e.ocupada) continue;
+                printf("%s{\"idx\": %d, \"op\": \"%s\", \"dest\": %d, \"pronta\": %s, \"valor\": %d, "
+                       "\"fisico\": %d, \"instr\": %d, \"thread\": %d}",
+                       primeira ? "" : ", ", t, NOMES_OP[(int)e.op], e.dest, e.pronta ? "true" : "false",
+                       sim.resultado_rob(t), e.fisico, e.indice_instr, e.thread);
+                primeira = false;
+            }
+            printf("], \"cabeca\": [");
+            for(int th = 0; th < sim.num_threads(); th++) printf("%s%d", th ? ", " : "", sim.cabeca_rob(th));
+            printf("]}\n");
+        }
+        else if(cmd == "rs") {
+            printf("{");
+            for(int u = (int)Unidade::RS_SOMA; u <= (int)Unidade::ARM; u++) {
+                if(u > (int)Unidade::RS_SOMA) printf(", ");
+                responder_estacoes(sim, (Unidade)u);
             }
+            printf("}\n");
+        }
+        else if(cmd == "estatisticas") {
+            const Estatisticas& e = sim.estatisticas();
+            printf("{\"ciclos\": %lld, \"emitidas\": %lld, \"consolidadas\": %lld, \"ipc\": %.6f, "
+                   "\"desvios\": %lld, \"desvios_mal_previstos\": %lld}\n",
+                   e.ciclos, e.emitidas, e.consolidadas, e.ciclos > 0 ? (double)e.consolidadas / e.ciclos : 0.0,
+                   e.desvios, e.desvios_mal_previstos);
         }
+        else printf("{\"erro\": \"comando desconhecido\"}\n");
+        fflush(stdout);
     }
+}
 
-    void transmitir_resultado(int tag_rob, int valor) {
-        // Atualiza estações de reserva de soma
-        for(auto& rs : RS_soma) {
-            if(rs.ocupada) {
-                if(rs.Qj == tag_rob) { rs.Vj = valor; rs.Qj = 0; }
-                if(rs.Qk == tag_rob) { rs.Vk = valor; rs.Qk = 0; }
+void uso(const char* prog) {
+    cerr << "Uso: " << prog << " [opcoes] [arquivo.txt]\n"
+         << "  --eventos               pula ciclos ociosos\n"
+         << "  --verbosidade=N         0 = nenhuma, 1 = resumo, 2 = completa (padrao)\n"
+         << "  --trace=arquivo.bin     grava trace binario por ciclo\n"
+         << "  --linha-tempo=arquivo   ciclos de cada instrucao (emissao, execucao, CDB, commit) em\n"
+         << "                          formato Konata, ou Chrome trace-event se terminar em .json\n"
+         << "  --decodificar=arq.bin   imprime um trace binario no formato de tabelas\n"
+         << "  --ciclos=A:B            com --decodificar, mostra so os ciclos de A a B\n"
+         << "  --param=NOME=VALOR      altera um parametro da maquina (ex.: TAM_ROB=64)\n"
+         << "  --maquina=NOME|arquivo  maquina predefinida (pequena, base, larga, enorme) ou arquivo\n"
+         << "                          de descricao com NOME=VALOR por linha; --param vale depois\n"
+         << "  --generico              nao usa os simuladores especializados das maquinas predefinidas\n"
+         << "  --preditor=TIPO         preditor de desvios: estatico, bimodal (padrao) ou gshare\n"
+         << "  --varredura             simula todas as combinacoes da grade para todos os programas\n"
+         << "  --grade=NOME=LISTA      eixo da varredura: \"2,4,8\" ou \"ini:fim[:passo]\"\n"
+         << "  --saida=arquivo         resultados da varredura (.csv ou .json; padrao: CSV na saida)\n"
+         << "  --threads=N             threads da varredura (padrao: todos os nucleos)\n"
+         << "  --estatisticas=arq.json exporta estatisticas e pilha de CPI em JSON\n"
+         << "  --montar=arq.tpb        grava a imagem binaria pre-decodificada do programa e sai\n"
+         << "  --cache=DIR             cache de imagens binarias, indexado pelo hash do fonte\n"
+         << "  --verificar-alocacoes   falha se o laco de simulacao alocar memoria no heap\n"
+         << "  --benchmark             mede o desempenho do simulador em nucleos sinteticos\n"
+         << "                          (e nos arquivos dados); resultado em --saida\n"
+         << "  --repeticoes=N          rodadas por nucleo no benchmark (padrao: 5)\n"
+         << "  --tamanho=N             instrucoes por nucleo do benchmark (padrao: 200000)\n"
+         << "  --gerador=CHAVE=V,...   programa sintetico: instrucoes, semente, mix=ADD/SUB/MUL/DIV/LD/ST,\n"
+         << "                          distancia, cadeias, arm (fracao de ST); simulado sem arquivo\n"
+         << "  --gerar=arquivo.txt     grava o programa do --gerador em texto (\"-\" = saida padrao) e sai\n"
+         << "  --checkpoint=N:arq.ckp  grava o estado completo da maquina no inicio do ciclo N\n"
+         << "  --memoria=arq.bin[@B]   imagem inicial da memoria (palavras de 32 bits little-endian),\n"
+         << "                          a partir do endereco B (padrao: 0)\n"
+         << "  --retomar=arq.ckp       continua a simulacao de um checkpoint (mesmo programa)\n"
+         << "  --amostragem[=CHAVE=V,...] simulacao detalhada so em janelas (intervalo, aquecimento,\n"
+         << "                          janela, em instrucoes); o resto e executado funcionalmente\n"
+         << "  --extrapolar[=N]        depois de N repeticoes seguidas do regime permanente de um laco\n"
+         << "                          (padrao: 3), extrapola o tempo do resto dele e o executa\n"
+         << "                          funcionalmente\n"
+         << "  --verificar-extrapolacao roda tambem a simulacao completa e compara os ciclos\n"
+         << "  --multinucleo           um nucleo (e uma thread) por arquivo, com memoria compartilhada\n"
+         << "  --quantum=N             ciclos entre as barreiras do multinucleo (padrao: 100)\n"
+         << "  --deterministico        no multinucleo, aplica as escritas de cada barreira na ordem\n"
+         << "                          dos nucleos, e nao na de chegada\n"
+         << "  --smt                   um nucleo com uma thread de hardware por arquivo (ate 8)\n"
+         << "  --rob-smt=MODO          ROB do SMT: particionado (padrao) ou compartilhado\n"
+         << "  --politica-smt=NOME     prioridade de emissao do SMT: icount (padrao) ou rodizio\n"
+         << "  --depurar               controla a simulacao por comandos na entrada padrao (passo,\n"
+         << "                          continuar, parar, vigiar, regs, mem, rob, rs...), com\n"
+         << "                          respostas em JSON, uma por linha\n";
+}
+
+int main(int argc, char** argv) {
+    vector<string> arquivos;
+    string arquivo_trace, arquivo_linha_tempo, arquivo_decodificar, arquivo_saida, arquivo_estatisticas;
+    string arquivo_imagem, dir_cache, arquivo_retomar, arquivo_memoria;
+    uint32_t base_memoria = 0;
+    ParametrosAmostragem amostragem;
+    bool amostrar = false;
+    bool multinucleo = false, deterministico = false;
+    int quantum = 100;
+    bool smt = false;
+    bool depurar_simulacao = false;
+    int ciclo_inicio = 1, ciclo_fim = 0;
+    OpcoesExecucao opcoes;
+    ConfigMaquina cfg;
+    bool varredura = false;
+    bool verificar_alocacoes = false;
+    bool verificar_extrapolacao = false;
+    bool benchmark = false;
+    bool especializar = true;
+    int repeticoes = 5, tamanho_nucleo = 200000;
+    ParametrosGerador gerador;
+    bool usar_gerador = false;
+    string arquivo_gerado;
+    vector<EixoVarredura> eixos;
+    size_t nthreads = max(1u, thread::hardware_concurrency());
+    
+    for(int i = 1; i < argc; i++) {
+        string arg = argv[i];
+        if(arg == "--eventos") opcoes.dirigido_eventos = true;
+        else if(arg.rfind("--verbosidade=", 0) == 0) {
+            int v = atoi(arg.c_str() + 14);
+            opcoes.verbosidade = v <= 0 ? Verbosidade::NENHUMA :
+                                 v == 1 ? Verbosidade::RESUMO : Verbosidade::COMPLETA;
+        }
+        else if(arg.rfind("--trace=", 0) == 0) arquivo_trace = arg.substr(8);
+        else if(arg.rfind("--linha-tempo=", 0) == 0) arquivo_linha_tempo = arg.substr(14);
+        else if(arg.rfind("--decodificar=", 0) == 0) arquivo_decodificar = arg.substr(14);
+        else if(arg.rfind("--ciclos=", 0) == 0) {
+            if(sscanf(arg.c_str() + 9, "%d:%d", &ciclo_inicio, &ciclo_fim) < 1) {
+                uso(argv[0]);
+                return 1;
             }
         }
-        
-        // Atualiza estações de reserva de multiplicação/divisão
-        for(auto& rs : RS_mul) {
-            if(rs.ocupada) {
-                if(rs.Qj == tag_rob) { rs.Vj = valor; rs.Qj = 0; }
-                if(rs.Qk == tag_rob) { rs.Vk = valor; rs.Qk = 0; }
+        else if(arg.rfind("--param=", 0) == 0 || arg.rfind("--grade=", 0) == 0) {
+            EixoVarredura eixo;
+            if(!ler_atribuicao(arg.substr(8), eixo.parametro, eixo.valores) ||
+               (arg[2] == 'p' && eixo.valores.size() != 1)) {
+                cerr << "Parametro invalido: " << arg << endl;
+                return 1;
             }
+            if(arg[2] == 'p') cfg.*(eixo.parametro->campo) = eixo.valores[0];
+            else eixos.push_back(eixo);
         }
-        
-        // Atualiza buffers de store
-        for(auto& sb : BufferArm) {
-            if(sb.ocupado && sb.Q == tag_rob) {
-                sb.V = valor;
-                sb.Q = 0;
+        else if(arg.rfind("--maquina=", 0) == 0) {
+            string nome = arg.substr(10), erro;
+            if(!aplicar_predefinida(nome, cfg, FormasPredefinidas()) && !ler_descricao_maquina(nome, cfg, erro)) {
+                cerr << erro << endl;
+                return 1;
             }
         }
-        
-        // Atualiza registradores
-        for(auto& reg : arquivo_reg) {
-            if(reg.tag == tag_rob) {
-                reg.valor = valor;
-            }
-        }
-    }
-
-    void avancar_execucao_e_escrever(int ciclo) {
-        // Execução nas estações de reserva de soma/subtração
-        for(auto& rs : RS_soma) {
-            if(rs.ocupada && rs.executando) {
-                rs.ciclosExecRestantes--;
-                if(rs.ciclosExecRestantes <= 0) {
-                    int res = 0;
-                    switch(rs.op) {
-                        case TipoOp::ADD: res = rs.Vj + rs.Vk; break;
-                        case TipoOp::SUB: res = rs.Vj - rs.Vk; break;
-                        default: break;
-                    }
-                    
-                    int tag = rs.indice_rob;
-                    EntradaROB* r = entrada_rob(tag);
-                    r->valor = res;
-                    r->pronta = true;
-                    
-                    transmitir_resultado(tag, res);
-                    rs.ocupada = false;
-                    rs.executando = false;
-                }
+        else if(arg == "--generico") especializar = false;
+        else if(arg.rfind("--preditor=", 0) == 0) {
+            string nome = arg.substr(11);
+            int t = 0;
+            while(t < 3 && nome != NOMES_PREDITOR[t]) t++;
+            if(t == 3) {
+                cerr << "Preditor invalido: " << nome << " (estatico, bimodal ou gshare)" << endl;
+                return 1;
             }
+            cfg.preditor = t;
         }
-        
-        // Execução nas estações de reserva de multiplicação/divisão
-        for(auto& rs : RS_mul) {
-            if(rs.ocupada && rs.executando) {
-                rs.ciclosExecRestantes--;
-                if(rs.ciclosExecRestantes <= 0) {
-                    int res = 0;
-                    switch(rs.op) {
-                        case TipoOp::MUL: res = rs.Vj * rs.Vk; break;
-                        case TipoOp::DIV:
-                            res = (rs.Vk != 0) ? rs.Vj / rs.Vk : 0;
-                            break;
-                        default: break;
-                    }
-                    
-                    int tag = rs.indice_rob;
-                    EntradaROB* r = entrada_rob(tag);
-                    r->valor = res;
-                    r->pronta = true;
-                    
-                    transmitir_resultado(tag, res);
-                    rs.ocupada = false;
-                    rs.executando = false;
-                }
+        else if(arg == "--varredura") varredura = true;
+        else if(arg == "--verificar-alocacoes") verificar_alocacoes = contar_alocacoes = true;
+        else if(arg == "--benchmark") benchmark = true;
+        else if(arg.rfind("--repeticoes=", 0) == 0) repeticoes = max(1, atoi(arg.c_str() + 13));
+        else if(arg.rfind("--tamanho=", 0) == 0) tamanho_nucleo = max(1, atoi(arg.c_str() + 10));
+        else if(arg.rfind("--saida=", 0) == 0) arquivo_saida = arg.substr(8);
+        else if(arg.rfind("--estatisticas=", 0) == 0) arquivo_estatisticas = arg.substr(15);
+        else if(arg.rfind("--montar=", 0) == 0) arquivo_imagem = arg.substr(9);
+        else if(arg.rfind("--cache=", 0) == 0) dir_cache = arg.substr(8);
+        else if(arg.rfind("--gerador=", 0) == 0) {
+            if(!ler_parametros_gerador(arg.substr(10), gerador)) {
+                cerr << "Parametros do gerador invalidos: " << arg << endl;
+                return 1;
             }
+            usar_gerador = true;
         }
-        
-        // Execução de loads (carregamento imediato)
-        for(auto& lb : BufferCarga) {
-            if(lb.ocupado && lb.executando) {
-                lb.ciclosExecRestantes--;
-                if(lb.ciclosExecRestantes <= 0) {
-                    int val = lb.endereco;
-                    
-                    int tag = lb.indice_rob;
-                    EntradaROB* r = entrada_rob(tag);
-                    r->valor = val;
-                    r->pronta = true;
-                    
-                    transmitir_resultado(tag, val);
-                    lb.ocupado = false;
-                    lb.executando = false;
-                }
+        else if(arg.rfind("--gerar=", 0) == 0) arquivo_gerado = arg.substr(8);
+        else if(arg.rfind("--checkpoint=", 0) == 0) {
+            size_t sep = arg.find(':', 13);
+            opcoes.ciclo_checkpoint = atoi(arg.c_str() + 13);
+            if(sep == string::npos || opcoes.ciclo_checkpoint < 1) {
+                uso(argv[0]);
+                return 1;
             }
+            opcoes.arquivo_checkpoint = arg.substr(sep + 1);
         }
-        
-        // Execução de stores
-        for(auto& sb : BufferArm) {
-            if(sb.ocupado && sb.executando) {
-                sb.ciclosExecRestantes--;
-                if(sb.ciclosExecRestantes <= 0) {
-                    int tag = sb.indice_rob;
-                    EntradaROB* r = entrada_rob(tag);
-                    r->pronta = true;
-                    r->valor_arm = sb.V;
-                    r->endereco_mem = sb.endereco;
-                    
-                    sb.ocupado = false;
-                    sb.executando = false;
-                }
+        else if(arg.rfind("--retomar=", 0) == 0) arquivo_retomar = arg.substr(10);
+        else if(arg.rfind("--memoria=", 0) == 0) {
+            arquivo_memoria = arg.substr(10);
+            size_t arroba = arquivo_memoria.rfind('@');
+            if(arroba != string::npos) {
+                base_memoria = (uint32_t)strtoul(arquivo_memoria.c_str() + arroba + 1, nullptr, 0);
+                arquivo_memoria.resize(arroba);
             }
         }
-    }
-
-    void consolidar() {
-        if(ROB[cabeca_rob].ocupada && ROB[cabeca_rob].pronta) {
-            EntradaROB& r = ROB[cabeca_rob];
-            
-            // Instruções de store: escrever na memória
-            if(r.op == TipoOp::ST) {
-                int addr = r.endereco_mem;
-                if(addr >= 0 && addr < TAM_MEM) {
-                    memoria[addr] = r.valor_arm;
-                }
-            } 
-            // Outras instruções: atualizar registradores
-            else if(r.op == TipoOp::LD || r.op == TipoOp::ADD || 
-                     r.op == TipoOp::SUB || r.op == TipoOp::MUL || 
-                     r.op == TipoOp::DIV) {
-                int dest = r.dest;
-                if(dest >= 0 && dest < REGISTRADORES) {
-                    if(arquivo_reg[dest].tag == cabeca_rob) {
-                        arquivo_reg[dest].valor = r.valor;
-                        arquivo_reg[dest].tag = 0;
-                    }
-                }
+        else if(arg.rfind("--amostragem", 0) == 0) {
+            if(arg.size() > 12 && (arg[12] != '=' || !ler_parametros_amostragem(arg.substr(13), amostragem))) {
+                cerr << "Parametros de amostragem invalidos: " << arg << endl;
+                return 1;
+            }
+            amostrar = true;
+        }
+        else if(arg.rfind("--extrapolar", 0) == 0) {
+            opcoes.extrapolar_lacos = ITERACOES_EXTRAPOLACAO;
+            if(arg.size() > 12) opcoes.extrapolar_lacos = arg[12] == '=' ? atoi(arg.c_str() + 13) : 0;
+            if(opcoes.extrapolar_lacos < 1) {
+                cerr << "Numero de iteracoes invalido: " << arg << endl;
+                return 1;
+            }
+        }
+        else if(arg == "--verificar-extrapolacao") verificar_extrapolacao = true;
+        else if(arg.rfind("--threads=", 0) == 0) nthreads = max(1, atoi(arg.c_str() + 10));
+        else if(arg == "--multinucleo") multinucleo = true;
+        else if(arg.rfind("--quantum=", 0) == 0) {
+            quantum = atoi(arg.c_str() + 10);
+            if(quantum < 1 || quantum > QUANTUM_MAXIMO) {
+                cerr << "Quantum invalido (1 a " << QUANTUM_MAXIMO << "): " << arg << endl;
+                return 1;
             }
-            
-            // Libera entrada do ROB
-            r = EntradaROB();
-            cabeca_rob = (cabeca_rob % TAM_ROB) + 1;
         }
+        else if(arg == "--deterministico") deterministico = true;
+        else if(arg == "--smt") smt = true;
+        else if(arg == "--depurar") depurar_simulacao = true;
+        else if(arg.rfind("--rob-smt=", 0) == 0) {
+            string nome = arg.substr(10);
+            int m = 0;
+            while(m < 2 && nome != NOMES_ROB_SMT[m]) m++;
+            if(m == 2) {
+                cerr << "ROB do SMT invalido: " << nome << " (particionado ou compartilhado)" << endl;
+                return 1;
+            }
+            cfg.rob_smt = m;
+        }
+        else if(arg.rfind("--politica-smt=", 0) == 0) {
+            string nome = arg.substr(15);
+            int m = 0;
+            while(m < 2 && nome != NOMES_POLITICA_SMT[m]) m++;
+            if(m == 2) {
+                cerr << "Politica do SMT invalida: " << nome << " (rodizio ou icount)" << endl;
+                return 1;
+            }
+            cfg.politica_smt = m;
+        }
+        else if(arg.rfind("--", 0) == 0) {
+            uso(argv[0]);
+            return 1;
+        }
+        else arquivos.push_back(arg);
     }
-
-
-    void imprimir_estado(int ciclo) const {
-        cout << "------------------------------------------------------------\n";
-        cout << "CICLO: " << ciclo << "\n";
-        cout << "PC: " << pc << " / " << filaInstr.size() << "\n";
-        
-        cout << "\nESTACOES DE RESERVA (ADD/SUB):\n";
-        cout << "Idx | Ocup | Op  | Vj   | Vk   | Qj | Qk | ROB\n";
-        for(size_t i = 0; i < RS_SOMA_COUNT; i++) {
-            printf("%3zu |  %3d | %3s | %4d | %4d | %2d | %2d | %2d\n",
-                i, RS_soma[i].ocupada ? 1 : 0, 
-                RS_soma[i].ocupada ? nomeOp(RS_soma[i].op) : "--",
-                RS_soma[i].Vj, RS_soma[i].Vk, RS_soma[i].Qj, RS_soma[i].Qk, 
-                RS_soma[i].indice_rob);
+    // No depurador a saída padrão é só das respostas
+    if(depurar_simulacao) opcoes.verbosidade = Verbosidade::NENHUMA;
+    // Na varredura, cada ponto da grade é conferido à parte
+    int threads_nucleo = smt ? max(1, (int)arquivos.size()) : 1;
+    if(!varredura && !regs_fisicos_suficientes(cfg, threads_nucleo)) {
+        cerr << "REGS_FISICOS=" << cfg.regs_fisicos << " precisa ser 0 ou maior que "
+             << REGISTRADORES * threads_nucleo << endl;
+        return 1;
+    }
+    if(!varredura && !erro_cache(cfg).empty()) {
+        cerr << erro_cache(cfg) << endl;
+        return 1;
+    }
+    if(verificar_extrapolacao && opcoes.extrapolar_lacos == 0) opcoes.extrapolar_lacos = ITERACOES_EXTRAPOLACAO;
+    if(opcoes.extrapolar_lacos > 0 && (smt || multinucleo || varredura || amostrar || depurar_simulacao ||
+       !arquivo_trace.empty() || !arquivo_linha_tempo.empty() || opcoes.ciclo_checkpoint > 0)) {
+        cerr << "--extrapolar nao combina com --smt, --multinucleo, --varredura, --amostragem, --depurar, "
+                "--trace, --linha-tempo ou --checkpoint" << endl;
+        return 1;
+    }
+    const ParametrosGerador* programa_gerado = usar_gerador ? &gerador : nullptr;
+    if(!arquivo_gerado.empty()) {
+        if(!gravar_programa_gerado(gerador, arquivo_gerado)) {
+            cerr << "Erro ao criar arquivo: " << arquivo_gerado << endl;
+            return 1;
         }
-        
-        cout << "\nESTACOES DE RESERVA (MUL/DIV):\n";
-        cout << "Idx | Ocup | Op  | Vj   | Vk   | Qj | Qk | ROB\n";
-        for(size_t i = 0; i < RS_MUL_COUNT; i++) {
-            printf("%3zu |  %3d | %3s | %4d | %4d | %2d | %2d | %2d\n",
-                i, RS_mul[i].ocupada ? 1 : 0, 
-                RS_mul[i].ocupada ? nomeOp(RS_mul[i].op) : "--",
-                RS_mul[i].Vj, RS_mul[i].Vk, RS_mul[i].Qj, RS_mul[i].Qk, 
-                RS_mul[i].indice_rob);
+        return 0;
+    }
+    if(benchmark) {
+        return executar_benchmark(cfg, opcoes.dirigido_eventos, arquivos, dir_cache, programa_gerado,
+                                  tamanho_nucleo, repeticoes, arquivo_saida, especializar);
+    }
+    if(arquivos.empty() && !usar_gerador) arquivos.push_back("instrucoes.txt");
+    
+    if(!arquivo_decodificar.empty()) {
+        return decodificar_trace(arquivo_decodificar, ciclo_inicio, ciclo_fim);
+    }
+    
+    if(!arquivo_imagem.empty()) {
+        ImagemPrograma img;
+        string erro;
+        if(arquivos.empty()) {
+            MontadorPrograma m;
+            gerar_programa(gerador, [&](const Instr& ins) { m.adicionar(ins); });
+            img.montar(m);
         }
-        
-        cout << "\nBUFFERS DE CARGA (Load Immediate):\n";
-        cout << "Idx | Ocup | Imm  | ROB | ExecRest\n";
-        for(size_t i = 0; i < BUFFER_CARGA_COUNT; i++) {
-            printf("%3zu |  %3d | %4d |  %2d | %3d\n",
-                i, BufferCarga[i].ocupado ? 1 : 0, BufferCarga[i].endereco, 
-                BufferCarga[i].indice_rob, BufferCarga[i].ciclosExecRestantes);
+        else if(!img.montar(arquivos[0], erro)) {
+            cerr << erro << endl;
+            return 1;
         }
-        
-        cout << "\nBUFFERS DE ARMAZENAMENTO:\n";
-        cout << "Idx | Ocup | Endr | V | Q | ROB | ExecRest\n";
-        for(size_t i = 0; i < BUFFER_ARM_COUNT; i++) {
-            printf("%3zu |  %3d | %4d | %2d | %2d | %2d | %3d\n",
-                i, BufferArm[i].ocupado ? 1 : 0, BufferArm[i].endereco, 
-                BufferArm[i].V, BufferArm[i].Q, BufferArm[i].indice_rob, 
-                BufferArm[i].ciclosExecRestantes);
+        if(!img.gravar(arquivo_imagem)) {
+            cerr << "Erro ao criar imagem: " << arquivo_imagem << endl;
+            return 1;
         }
-        
-        cout << "\nROB (cabeca=" << cabeca_rob << " cauda=" << cauda_rob << "):\n";
-        cout << "Idx | Ocup | Op  | Dest | Pronta | Valor | Instr\n";
-        for(int i = 1; i <= TAM_ROB; i++) {
-            const EntradaROB& r = ROB[i];
-            if(r.ocupada) {
-                printf("%3d |  %3d | %3s |  %3d |   %3d | %5d | %s\n", 
-                    i, r.ocupada ? 1 : 0, nomeOp(r.op), r.dest, 
-                    r.pronta ? 1 : 0, r.valor, r.texto_instr.c_str());
+        printf("Montadas %d instrucoes em %s\n", img.tamanho(), arquivo_imagem.c_str());
+        return 0;
+    }
+    
+    if(smt) {
+        if(multinucleo || varredura || usar_gerador || amostrar || !arquivo_trace.empty() || opcoes.ciclo_checkpoint > 0 ||
+           !arquivo_retomar.empty()) {
+            cerr << "--smt nao combina com --multinucleo, --varredura, --gerador, --amostragem, --trace, "
+                    "--checkpoint ou --retomar" << endl;
+            return 1;
+        }
+        int n = (int)arquivos.size();
+        if(n > MAX_THREADS_SMT) {
+            cerr << "No maximo " << MAX_THREADS_SMT << " threads no SMT" << endl;
+            return 1;
+        }
+        if(cfg.rob_smt == ROB_SMT_PARTICIONADO && cfg.tam_rob / n < 2) {
+            cerr << "TAM_ROB=" << cfg.tam_rob << " nao comporta " << n << " particoes" << endl;
+            return 1;
+        }
+    }
+    
+    if(varredura) {
+        return executar_varredura(cfg, eixos, arquivos, arquivo_saida, nthreads, dir_cache,
+                                  programa_gerado, especializar);
+    }
+    
+    if(multinucleo) {
+        if(usar_gerador || varredura || amostrar || !arquivo_trace.empty() || !arquivo_linha_tempo.empty() ||
+           opcoes.ciclo_checkpoint > 0 || !arquivo_retomar.empty()) {
+            cerr << "--multinucleo nao combina com --gerador, --amostragem, --trace, --linha-tempo, "
+                    "--checkpoint ou --retomar" << endl;
+            return 1;
+        }
+        return executar_multinucleo(cfg, arquivos, dir_cache, arquivo_memoria, base_memoria, quantum,
+                                    deterministico, opcoes, arquivo_estatisticas, especializar);
+    }
+    
+    // A máquina retomada é a do checkpoint (--param não vale aqui)
+    if(!arquivo_retomar.empty() && !config_checkpoint(arquivo_retomar, cfg)) {
+        cerr << "Checkpoint invalido ou ilegivel: " << arquivo_retomar << endl;
+        return 1;
+    }
+    
+    return com_simulador(cfg, [&](auto& sim) {
+        if(arquivos.empty()) {
+            if(opcoes.verbosidade != Verbosidade::NENHUMA) printf("Programa gerado pelo --gerador\n\n");
+            sim.definir_programa(gerar_imagem(gerador));
+        } else {
+            const string& arquivo = arquivos[0];
+            if(opcoes.verbosidade != Verbosidade::NENHUMA) {
+                printf("Carregando arquivo de instrucoes: %s\n\n", arquivo.c_str());
+            }
+            if(!sim.carregarPrograma(arquivo, dir_cache)) {
+                cerr << sim.erro_programa() << endl;
+                return 1;
             }
         }
-        
-        cout << "\nRegistradores (valor : tag):\n";
-        for(int i = 0; i < REGISTRADORES; i++) {
-            printf("R%02d=%5d : t=%2d\t", i, arquivo_reg[i].valor, arquivo_reg[i].tag);
-            if((i + 1) % 4 == 0) cout << "\n";
+        shared_ptr<const ImagemMemoria> img;
+        if(!arquivo_memoria.empty()) {
+            string erro;
+            img = carregar_imagem_memoria(arquivo_memoria, base_memoria, erro);
+            if(!img) {
+                cerr << erro << endl;
+                return 1;
+            }
+            sim.definir_imagem_memoria(img);
         }
         
-        cout << "\nMemoria (enderecos nao-zero ate 64):\n";
-        for(int i = 0; i < 64; i++) {
-            if(memoria[i] != 0) {
-                cout << "M[" << i << "]=" << memoria[i] << "  ";
+        // SMT: as demais threads, e o IPC de cada programa sozinho na mesma
+        // máquina, que é a base das métricas de justiça
+        if(smt && arquivos.size() > 1) {
+            using Simulador = remove_reference_t<decltype(sim)>;
+            vector<double> ipc_isolado;
+            for(size_t t = 0; t < arquivos.size(); t++) {
+                if(t > 0 && !sim.adicionar_thread(arquivos[t], dir_cache)) {
+                    cerr << sim.erro_programa() << endl;
+                    return 1;
+                }
+                auto sozinho = make_unique<Simulador>(cfg);
+                sozinho->carregarPrograma(arquivos[t], dir_cache);
+                if(img) sozinho->definir_imagem_memoria(img);
+                OpcoesExecucao silencioso;
+                silencioso.verbosidade = Verbosidade::NENHUMA;
+                silencioso.dirigido_eventos = true;
+                int ciclos = sozinho->executar(silencioso);
+                ipc_isolado.push_back(ciclos > 0 ? (double)sozinho->estatisticas().consolidadas / ciclos : 0.0);
+            }
+            sim.definir_ipc_isolado(move(ipc_isolado));
+        }
+        if(!arquivo_retomar.empty()) {
+            string erro;
+            if(!sim.restaurar_checkpoint(arquivo_retomar, erro)) {
+                cerr << erro << endl;
+                return 1;
             }
         }
-        cout << "\n------------------------------------------------------------\n";
-    }
-
-    bool finalizado() const {
-        if(pc < (int)filaInstr.size()) return false;
         
-        for(const auto& rs : RS_soma) if(rs.ocupada) return false;
-        for(const auto& rs : RS_mul) if(rs.ocupada) return false;
-        for(const auto& lb : BufferCarga) if(lb.ocupado) return false;
-        for(const auto& sb : BufferArm) if(sb.ocupado) return false;
+        GravadorTrace trace;
+        if(!arquivo_trace.empty()) {
+            // O trace guarda os valores no ROB, que o banco físico não usa
+            if(cfg.regs_fisicos > 0) {
+                cerr << "--trace nao combina com REGS_FISICOS > 0" << endl;
+                return 1;
+            }
+            if(!trace.abrir(arquivo_trace, sim.parametros_maquina(), sim.tamanho_estado())) {
+                cerr << "Erro ao criar trace: " << arquivo_trace << endl;
+                return 1;
+            }
+            opcoes.trace = &trace;
+        }
+        GravadorLinhaTempo linha_tempo;
+        if(!arquivo_linha_tempo.empty()) {
+            if(!linha_tempo.abrir(arquivo_linha_tempo, cfg.tam_rob, sim.num_threads())) {
+                cerr << "Erro ao criar linha do tempo: " << arquivo_linha_tempo << endl;
+                return 1;
+            }
+            opcoes.linha_tempo = &linha_tempo;
+        }
         
-        for(int i = 1; i <= TAM_ROB; i++) {
-            if(ROB[i].ocupada) return false;
+        if(depurar_simulacao) {
+            if(amostrar || opcoes.trace || opcoes.linha_tempo || opcoes.ciclo_checkpoint > 0) {
+                cerr << "--depurar nao combina com --amostragem, --trace, --linha-tempo ou --checkpoint" << endl;
+                return 1;
+            }
+            depurar(sim, opcoes.dirigido_eventos);
         }
+        else if(amostrar) {
+            if(opcoes.trace || opcoes.linha_tempo || opcoes.ciclo_checkpoint > 0 || !arquivo_retomar.empty()) {
+                cerr << "--amostragem nao combina com --trace, --linha-tempo, --checkpoint ou --retomar" << endl;
+                return 1;
+            }
+            sim.executar_amostrado(amostragem, opcoes);
+        }
+        else if(verificar_extrapolacao) {
+            auto inicio = chrono::steady_clock::now();
+            int ciclos = sim.executar(opcoes);
+            double segundos = chrono::duration<double>(chrono::steady_clock::now() - inicio).count();
+            
+            // A mesma execução sem extrapolar, como referência
+            using Simulador = remove_reference_t<decltype(sim)>;
+            auto completo = make_unique<Simulador>(cfg);
+            if(arquivos.empty()) completo->definir_programa(gerar_imagem(gerador));
+            else completo->carregarPrograma(arquivos[0], dir_cache);
+            if(img) completo->definir_imagem_memoria(img);
+            string erro;
+            if(!arquivo_retomar.empty()) completo->restaurar_checkpoint(arquivo_retomar, erro);
+            OpcoesExecucao silencioso;
+            silencioso.verbosidade = Verbosidade::NENHUMA;
+            silencioso.dirigido_eventos = opcoes.dirigido_eventos;
+            inicio = chrono::steady_clock::now();
+            int referencia = completo->executar(silencioso);
+            double segundos_completo = chrono::duration<double>(chrono::steady_clock::now() - inicio).count();
+            
+            bool iguais = sim.estatisticas().consolidadas == completo->estatisticas().consolidadas &&
+                          sim.registradores().consolidado == completo->registradores().consolidado;
+            printf("\nVERIFICACAO DA EXTRAPOLACAO:\n");
+            printf("  %-22s %12d  (%.3f s)\n", "ciclos extrapolados", ciclos, segundos);
+            printf("  %-22s %12d  (%.3f s)\n", "ciclos simulados", referencia, segundos_completo);
+            printf("  %-22s %+11.3f%%\n", "erro", referencia > 0 ? 100.0 * (ciclos - referencia) / referencia : 0.0);
+            printf("  %-22s %11.1fx\n", "aceleracao", segundos > 0 ? segundos_completo / segundos : 0.0);
+            printf("  %-22s %12s\n", "estado final", iguais ? "igual" : "DIFERENTE");
+            if(!iguais) return 1;
+        }
+        else sim.executar(opcoes);
+        if(!sim.erro_checkpoint().empty()) cerr << sim.erro_checkpoint() << endl;
         
-        return true;
-    }
-
-    void executar() {
-        int ciclo = 1;
+        // Erro encontrado só durante a leitura em streaming
+        if(!sim.erro_programa().empty()) {
+            cerr << sim.erro_programa() << endl;
+            return 1;
+        }
         
-        cout << "====== SIMULADOR TOMASULO ======\n";
-        cout << "Carregadas " << filaInstr.size() << " instrucoes.\n";
-        cout << "LD funciona como LI (Load Immediate)\n";
-        cout << "================================\n\n";
+        if(verificar_alocacoes) {
+            size_t n = sim.estatisticas().alocacoes_laco;
+            fprintf(stderr, "Alocacoes no heap durante a simulacao: %zu\n", n);
+            if(n > 0) return 1;
+        }
         
-        // Loop principal de execução ciclo a ciclo
-        while(!finalizado()) {
-            imprimir_estado(ciclo);
-            
-            // Estágios do algoritmo de Tomasulo
-            emitir();
-            tentar_iniciar_rs(RS_soma);
-            tentar_iniciar_rs(RS_mul);
-            tentar_iniciar_cargas();
-            tentar_iniciar_arms();
-            avancar_execucao_e_escrever(ciclo);
-            consolidar();
-            
-            ciclo++;
+        if(!arquivo_estatisticas.empty()) {
+            FILE* out = fopen(arquivo_estatisticas.c_str(), "w");
+            if(!out) {
+                cerr << "Erro ao criar arquivo de estatisticas: " << arquivo_estatisticas << endl;
+                return 1;
+            }
+            sim.escrever_estatisticas_json(out);
+            fclose(out);
         }
         
-        // Estado final
-        imprimir_estado(ciclo);
-        cout << "\n====== EXECUCAO FINALIZADA em " << ciclo - 1 << " ciclos ======\n";
-    }
-};
-
-int main(int argc, char** argv) {
-    string arquivo = "instrucoes.txt";
-    
-    if(argc >= 2) {
-        arquivo = argv[1];
-    }
-    
-    cout << "Carregando arquivo de instrucoes: " << arquivo << "\n\n";
-    
-    SimuladorTomasulo sim;
-    sim.carregarPrograma(arquivo);
-    sim.executar();
-    
-    return 0;
-}
\ No newline at end of file
+        return 0;
+    }, especializar);
+}